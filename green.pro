@@ -21,7 +21,7 @@ QML_IMPORT_NAME = Blockstream.Green
 QML_IMPORT_MAJOR_VERSION = 0
 QML_IMPORT_MINOR_VERSION = 1
 
-QT += qml quick quickcontrols2 svg
+QT += network qml quick quickcontrols2 svg
 
 CONFIG += c++11 metatypes qmltypes qtquickcompiler
 
@@ -46,11 +46,16 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += \
     src/accountcontroller.cpp \
     src/account.cpp \
+    src/amount.cpp \
+    src/apdu.cpp \
     src/asset.cpp \
+    src/assetcache.cpp \
+    src/asseticonprovider.cpp \
     src/balance.cpp \
     src/clipboard.cpp \
     src/controller.cpp \
     src/createaccountcontroller.cpp \
+    src/daemon.cpp \
     src/device.cpp \
     src/devicediscoveryagent.cpp \
     src/devicediscoveryagent_linux.cpp \
@@ -58,6 +63,9 @@ SOURCES += \
     src/devicediscoveryagent_win.cpp \
     src/devicelistmodel.cpp \
     src/devicemanager.cpp \
+    src/executor.cpp \
+    src/exportjob.cpp \
+    src/feeestimates.cpp \
     src/ga.cpp \
     src/handler.cpp \
     src/json.cpp \
@@ -68,22 +76,31 @@ SOURCES += \
     src/restorecontroller.cpp \
     src/sendtransactioncontroller.cpp \
     src/signupcontroller.cpp \
+    src/trace.cpp \
     src/transaction.cpp \
+    src/transactionlistmodel.cpp \
     src/twofactorcontroller.cpp \
     src/util.cpp \
     src/wallet.cpp \
+    src/walletcache.cpp \
     src/walletlistmodel.cpp \
     src/walletmanager.cpp \
-    src/wally.cpp
+    src/wally.cpp \
+    src/xpubcache.cpp
 
 HEADERS += \
     src/accountcontroller.h \
     src/account.h \
+    src/amount.h \
+    src/apdu.h \
     src/asset.h \
+    src/assetcache.h \
+    src/asseticonprovider.h \
     src/balance.h \
     src/clipboard.h \
     src/controller.h \
     src/createaccountcontroller.h \
+    src/daemon.h \
     src/device.h \
     src/device_p.h \
     src/devicediscoveryagent.h \
@@ -92,6 +109,9 @@ HEADERS += \
     src/devicediscoveryagent_win.h \
     src/devicelistmodel.h \
     src/devicemanager.h \
+    src/executor.h \
+    src/exportjob.h \
+    src/feeestimates.h \
     src/ga.h \
     src/handler.h \
     src/json.h \
@@ -101,13 +121,17 @@ HEADERS += \
     src/restorecontroller.h \
     src/sendtransactioncontroller.h \
     src/signupcontroller.h \
+    src/trace.h \
     src/transaction.h \
+    src/transactionlistmodel.h \
     src/twofactorcontroller.h \
     src/util.h \
     src/wallet.h \
+    src/walletcache.h \
     src/walletlistmodel.h \
     src/walletmanager.h \
-    src/wally.h
+    src/wally.h \
+    src/xpubcache.h
 
 RESOURCES += assets/assets.qrc qml/qml.qrc assets/svg.qrc
 win32 {
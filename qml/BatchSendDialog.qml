@@ -0,0 +1,113 @@
+import Blockstream.Green 0.1
+import QtQuick 2.13
+import QtQuick.Controls 2.13
+import QtQuick.Layouts 1.12
+
+ControllerDialog {
+    id: dialog
+    required property Account account
+    readonly property Wallet wallet: account.wallet
+    title: qsTrId('Batch Send')
+
+    controller: BatchSendController {
+        account: dialog.account
+    }
+
+    property var status_label: [
+        qsTrId('Pending'),
+        qsTrId('Invalid'),
+        qsTrId('Creating'),
+        qsTrId('Signing'),
+        qsTrId('Sending'),
+        qsTrId('Sent'),
+        qsTrId('Failed')
+    ]
+
+    // Return to the recipients after a batch needed two factor authentication.
+    Connections {
+        target: controller
+        function onDone() {
+            if (controller.running && stackView.depth > 1) stackView.pop(null)
+        }
+    }
+
+    doneText: qsTrId('%1 of %2 recipients paid').arg(controller.sentCount).arg(controller.validCount)
+    minimumWidth: 600
+    minimumHeight: 400
+
+    initialItem: FocusScope {
+        property list<Action> actions: [
+            Action {
+                text: qsTrId('Load CSV...')
+                enabled: !controller.running
+                onTriggered: controller.load()
+            },
+            Action {
+                text: controller.running ? qsTrId('id_cancel') : qsTrId('id_send')
+                enabled: controller.running || controller.validCount > controller.sentCount
+                onTriggered: controller.running ? controller.stop() : controller.send()
+            }
+        ]
+        implicitHeight: layout.implicitHeight
+        implicitWidth: layout.implicitWidth
+        ColumnLayout {
+            id: layout
+            anchors.fill: parent
+            Label {
+                text: controller.fileName === '' ? qsTrId('Load a CSV file with lines address,amount[,asset]') : controller.fileName
+                elide: Label.ElideMiddle
+                Layout.fillWidth: true
+            }
+            RowLayout {
+                Label {
+                    text: qsTrId('id_network_fee')
+                }
+                FeeComboBox {
+                    enabled: !controller.running
+                    Layout.fillWidth: true
+                    Component.onCompleted: controller.feeRate = feeRate
+                    onFeeRateChanged: if (feeRate) controller.feeRate = feeRate
+                }
+            }
+            ListView {
+                id: list_view
+                clip: true
+                model: controller.rows
+                Layout.fillWidth: true
+                Layout.fillHeight: true
+                Layout.minimumHeight: 200
+                ScrollIndicator.vertical: ScrollIndicator { }
+                delegate: RowLayout {
+                    width: list_view.width
+                    Label {
+                        text: modelData.line
+                        Layout.minimumWidth: 40
+                    }
+                    Label {
+                        text: modelData.address
+                        elide: Label.ElideMiddle
+                        Layout.fillWidth: true
+                    }
+                    Label {
+                        text: modelData.amount
+                    }
+                    Label {
+                        text: status_label[modelData.status] + (modelData.error !== '' ? ': ' + qsTrId(modelData.error) : '')
+                        ToolTip.text: modelData.txhash
+                        ToolTip.visible: modelData.txhash !== '' && status_mouse_area.containsMouse
+                        Layout.minimumWidth: 120
+                        MouseArea {
+                            id: status_mouse_area
+                            anchors.fill: parent
+                            hoverEnabled: true
+                        }
+                    }
+                }
+            }
+            Label {
+                visible: controller.rows.length > 0
+                text: qsTrId('%1 of %2 recipients paid').arg(controller.sentCount).arg(controller.validCount)
+            }
+        }
+    }
+}
@@ -8,6 +8,7 @@ WalletDialog {
     id: controller_dialog
     property Controller controller
     property alias initialItem: stack_view.initialItem
+    property alias stackView: stack_view
     property string description
     property string placeholder
     property string doneText: qsTrId('id_done')
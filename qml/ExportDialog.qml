@@ -0,0 +1,46 @@
+import Blockstream.Green 0.1
+import QtQuick 2.12
+import QtQuick.Controls 2.5
+import QtQuick.Layouts 1.12
+
+AbstractDialog {
+    id: dialog
+    property ExportJob job
+    title: qsTrId('Export Transactions')
+    closePolicy: Popup.NoAutoClose
+    onClosed: destroy()
+    // The job is owned by C++, it's no longer needed once the dialog is gone.
+    Component.onDestruction: if (job) job.deleteLater()
+
+    footer: DialogButtonBox {
+        Button {
+            flat: true
+            text: job.running ? qsTrId('id_cancel') : qsTrId('id_ok')
+            onClicked: {
+                if (job.running) job.cancel()
+                else dialog.close()
+            }
+        }
+    }
+
+    ColumnLayout {
+        spacing: 8
+        Label {
+            text: job.fileName
+            elide: Label.ElideMiddle
+            Layout.maximumWidth: 400
+        }
+        ProgressBar {
+            from: 0
+            to: Math.max(job.total, 1)
+            value: job.progress
+            // Rows are still being fetched.
+            indeterminate: job.running && job.total === 0
+            Layout.fillWidth: true
+        }
+        Label {
+            visible: !job.running && job.error !== ''
+            text: job.error
+        }
+    }
+}
@@ -6,7 +6,8 @@ ComboBox {
     property int blocks: model[currentIndex].blocks
 
     function fee(label, duration, blocks) {
-        const feeRate = wallet.events.fees[blocks] ;
+        // Reading available makes bindings follow estimate changes.
+        const feeRate = wallet.feeEstimates.available ? wallet.feeEstimates.rate(blocks) : 0
         const text = qsTrId(label) + ' ' + qsTrId(duration) + ' ( '+ Math.round(feeRate / 10 + 0.5) / 100 + ' sat/vB)';
         return { blocks, feeRate, text }
     }
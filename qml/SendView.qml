@@ -176,7 +176,7 @@ StackView {
                 extra: wallet.network.liquid ? [] : [{ text: qsTrId('id_custom') }]
                 Component.onCompleted: {
                     currentIndex = wallet.network.liquid ? 0 : indexes.indexOf(wallet.settings.required_num_blocks)
-                    controller.feeRate = wallet.events.fees[blocks]
+                    controller.feeRate = wallet.feeEstimates.rate(blocks)
                 }
                 onFeeRateChanged: {
                     if (feeRate) {
@@ -6,10 +6,12 @@ ListView {
     id: list_view
     property Account account
     clip: true
-    model: account.transactions
+    model: TransactionListModel {
+        account: list_view.account
+    }
     delegate: TransactionDelegate {
         width: list_view.width
-        transaction: modelData
+        transaction: model.transaction
         onClicked: stack_view.push(transaction_view_component, { transaction })
     }
     ScrollBar.vertical: ScrollBar { }
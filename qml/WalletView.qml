@@ -22,6 +22,8 @@ Item {
 
     function formatFiat(sats, include_ticker = true) {
         const pricing = wallet.settings.pricing;
+        // Bindings are reevaluated once the rate arrives or changes.
+        const rate = wallet.fiatRate;
         const { fiat, fiat_currency } = wallet.convert({ satoshi: sats });
         return (fiat === null ? 'n/a' : Number(fiat).toLocaleString(Qt.locale(), 'f', 2)) + (include_ticker ? ' ' + fiat_currency : '');
     }
@@ -42,7 +44,7 @@ Item {
         return qsTrId('id_completed');
     }
 
-    readonly property bool fiatRateAvailable: formatFiat(0, false) !== 'n/a'
+    readonly property bool fiatRateAvailable: wallet.fiatRate !== ''
 
     property Item toolbar: RowLayout {
         ProgressBar {
@@ -147,7 +147,28 @@ ApplicationWindow {
                         model: currentWallet ? currentWallet.accounts : null
                         MenuItem {
                             text: modelData.name
-                            onTriggered: modelData.exportCSV()
+                            onTriggered: {
+                                const job = modelData.exportCSV()
+                                if (job) export_dialog.createObject(window, { job: job }).open()
+                            }
+                        }
+                    }
+                }
+                Menu {
+                    title: qsTrId('Export Wallet Transactions')
+                    enabled: currentWallet && currentWallet.authentication === Wallet.Authenticated
+                    Repeater {
+                        model: [
+                            { text: 'CSV', format: ExportJob.Csv },
+                            { text: 'JSON Lines', format: ExportJob.JsonLines },
+                            { text: 'Columnar', format: ExportJob.Columnar }
+                        ]
+                        MenuItem {
+                            text: modelData.text
+                            onTriggered: {
+                                const job = currentWallet.exportTransactions(modelData.format)
+                                if (job) export_dialog.createObject(window, { job: job }).open()
+                            }
                         }
                     }
                 }
@@ -180,6 +201,11 @@ ApplicationWindow {
                     enabled: currentWallet && currentWallet.authentication === Wallet.Authenticated && currentAccount && currentAccount.json.type !== '2of2_no_recovery'
                     onClicked: rename_account_dialog.createObject(window, { account: currentAccount }).open()
                 }
+                MenuItem {
+                    text: qsTrId('Batch Send...')
+                    enabled: currentWallet && currentWallet.authentication === Wallet.Authenticated && currentAccount
+                    onClicked: batch_send_dialog.createObject(window, { account: currentAccount }).open()
+                }
             }
             Menu {
                 title: qsTrId('id_help')
@@ -194,6 +220,12 @@ ApplicationWindow {
                         Qt.openUrlExternally("https://docs.blockstream.com/green/support.html")
                     }
                 }
+                MenuItem {
+                    text: qsTrId('Save Trace...')
+                    visible: Tracer.enabled
+                    height: visible ? implicitHeight : 0
+                    onClicked: Tracer.save()
+                }
             }
         }
         Item {
@@ -336,11 +368,21 @@ ApplicationWindow {
         }
     }
 
+    Component {
+        id: export_dialog
+        ExportDialog {}
+    }
+
     Component {
         id: rename_account_dialog
         RenameAccountDialog {}
     }
 
+    Component {
+        id: batch_send_dialog
+        BatchSendDialog {}
+    }
+
     Component {
         id: create_account_dialog
         CreateAccountDialog {
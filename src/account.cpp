@@ -1,11 +1,16 @@
 #include "account.h"
+#include "amount.h"
 #include "asset.h"
 #include "balance.h"
+#include "executor.h"
+#include "exportjob.h"
 #include "ga.h"
 #include "json.h"
 #include "network.h"
+#include "trace.h"
 #include "transaction.h"
 #include "wallet.h"
+#include "walletcache.h"
 
 #include <QFileDialog>
 #include <QFile>
@@ -33,13 +38,6 @@ QJsonObject Account::json() const
     return m_json;
 }
 
-QQmlListProperty<Transaction> Account::transactions()
-{
-    return QQmlListProperty<Transaction>(this, &m_transactions,
-        [](QQmlListProperty<Transaction>* property) { return static_cast<QVector<Transaction*>*>(property->data)->size(); },
-    [](QQmlListProperty<Transaction>* property, int index) { return static_cast<QVector<Transaction*>*>(property->data)->at(index); });
-}
-
 void Account::update(const QJsonObject& json)
 {
     m_json = json;
@@ -53,45 +51,35 @@ void Account::updateBalance()
 {
     if (wallet()->network()->isLiquid()) {
         auto satoshi = m_json.value("satoshi").toObject();
-        auto balance_by_id = m_balance_by_id;
-        m_balance_by_id.clear();
+        auto balance_by_asset = m_balance_by_asset;
+        m_balance_by_asset.clear();
         m_balances.clear();
         for (auto i = satoshi.constBegin(); i != satoshi.constEnd(); ++i) {
-            Balance* balance = balance_by_id.take(i.key());
+            const int index = wallet()->assetIndex(i.key());
+            Balance* balance = balance_by_asset.take(index);
             if (!balance) balance = new Balance(this);
-            m_balance_by_id.insert(i.key(), balance);
-            balance->setAsset(wallet()->getOrCreateAsset(i.key()));
+            m_balance_by_asset.insert(index, balance);
+            balance->setAssetIndex(index);
             balance->setAmount(i.value().toDouble());
             m_balances.append(balance);
         }
-        std::sort(m_balances.begin(), m_balances.end(), [](const Balance* b1, const Balance* b2) {
-            Asset* a1 = b1->asset();
-            Asset* a2 = b2->asset();
-
-            if (a1->isLBTC()) return true;
-            if (a2->isLBTC()) return false;
-
-            if (a1->hasIcon() && !a2->hasIcon()) return true;
-            if (a2->hasIcon() && !a1->hasIcon()) return false;
-            if (a1->hasIcon() && a2->hasIcon()) return a1->name() < a2->name();
-
-            if (a1->hasData() && !a2->hasData()) return true;
-            if (a2->hasData() && !a1->hasData()) return false;
-            if (a1->hasData() && a2->hasData()) return a1->name() < a2->name();
-
-            return a1->name() < a2->name();
+        const auto wallet = this->wallet();
+        std::sort(m_balances.begin(), m_balances.end(), [wallet](const Balance* b1, const Balance* b2) {
+            return Asset::lessThan(wallet->asset(b1->assetIndex()), wallet->asset(b2->assetIndex()));
         });
         emit balancesChanged();
-        qDeleteAll(balance_by_id.values());
+        qDeleteAll(balance_by_asset);
     }
 
     emit balanceChanged();
 }
 
-void Account::handleNotification(const QJsonObject &notification)
+void Account::setBalance(const QJsonObject& satoshi)
 {
-    Q_UNUSED(notification);
-    reload();
+    m_json.insert("satoshi", satoshi);
+    emit jsonChanged();
+
+    updateBalance();
 }
 
 qint64 Account::balance() const
@@ -104,60 +92,100 @@ QQmlListProperty<Balance> Account::balances()
     return { this, &m_balances };
 }
 
-static QJsonArray get_transactions(GA_session* session, int subaccount, int first, int count)
+void Account::reload()
 {
-    auto result = GA::process_auth([session, subaccount, first, count] (GA_auth_handler** call) {
-        GA_json* details = Json::fromObject({
-            { "subaccount", subaccount },
-            { "first", first },
-            { "count", count }
-        });
-
-        int err = GA_get_transactions(session, details, call);
-        Q_ASSERT(err == GA_OK);
+    fetchTransactions(false);
+}
 
-        err = GA_destroy_json(details);
-        Q_ASSERT(err == GA_OK);
-    });
-    Q_ASSERT(result.value("status").toString() == "done");
-    return result.value("result").toObject().value("transactions").toArray();
+void Account::resync()
+{
+    fetchTransactions(true);
 }
 
-void Account::reload()
+void Account::fetchTransactions(bool full)
 {
-    QMetaObject::invokeMethod(m_wallet->m_context, [this] {
-        QList<QJsonArray> transactions;
+    // Hashes already loaded and hashes of transactions that can still change
+    // (not in a block yet). An incremental fetch walks from the newest page and
+    // stops once it reaches a known transaction and has seen every pending one.
+    QSet<QString> known, pending;
+    if (!full) {
+        for (auto transaction : m_transactions) {
+            const auto hash = transaction->data().value("txhash").toString();
+            known.insert(hash);
+            if (transaction->isUnconfirmed()) pending.insert(hash);
+        }
+    }
+
+    m_wallet->m_context->post([this, full, known, pending] {
+        Trace::Scope trace("Account::reload");
+        QJsonArray transactions;
+        bool complete = false;
+        bool reached_known = false;
+        auto remaining = pending;
         int first = 0;
         int count = 30;
         while (true) {
-            auto values = get_transactions(m_wallet->m_session, m_pointer, first, count);
-            transactions.push_back(values);
-            if (values.size() < count) break;
+            auto values = GA::get_transactions(m_wallet->m_session, m_pointer, first, count);
+            for (auto value : values) {
+                const auto hash = value.toObject().value("txhash").toString();
+                if (known.contains(hash)) reached_known = true;
+                remaining.remove(hash);
+                transactions.append(value);
+            }
+            if (values.size() < count) {
+                complete = true;
+                break;
+            }
+            if (!full && reached_known && remaining.isEmpty()) break;
             first += count;
         }
 
-        QMetaObject::invokeMethod(this, [this, transactions] {
-            m_transactions.clear();
-            m_have_unconfirmed = false;
-            for (auto list : transactions) {
-                for (auto value : list) {
-                    QJsonObject data = value.toObject();
-                    auto hash = data.value("txhash").toString();
-                    auto transaction = m_transactions_by_hash.value(hash);
-                    if (!transaction) {
-                        transaction = new Transaction(this);
-                        m_transactions_by_hash.insert(hash, transaction);
-                    }
-                    transaction->updateFromData(data);
-                    m_transactions.append(transaction);
-                    if (transaction->isUnconfirmed()) m_have_unconfirmed = true;
-                }
-            }
-            emit transactionsChanged();
+        trace.setSize(transactions.size());
+
+        if (m_wallet->m_cache) {
+            m_wallet->m_cache->appendTransactions(m_pointer, transactions, complete);
+        }
+
+        QMetaObject::invokeMethod(this, [this, transactions, complete] {
+            updateTransactions(transactions, complete);
         }, Qt::QueuedConnection);
     });
 }
 
+void Account::updateTransactions(const QJsonArray& transactions, bool complete)
+{
+    QVector<Transaction*> result;
+    QSet<Transaction*> updated;
+    for (auto value : transactions) {
+        QJsonObject data = value.toObject();
+        auto hash = data.value("txhash").toString();
+        auto transaction = m_transactions_by_hash.value(hash);
+        if (!transaction) {
+            transaction = new Transaction(this);
+            m_transactions_by_hash.insert(hash, transaction);
+        }
+        transaction->updateFromData(data);
+        result.append(transaction);
+        updated.insert(transaction);
+    }
+    // Partial fetch only covers the newest transactions, keep the
+    // older ones that were already loaded.
+    if (!complete) {
+        for (auto transaction : m_transactions) {
+            if (!updated.contains(transaction)) result.append(transaction);
+        }
+    }
+    m_transactions = result;
+    m_have_unconfirmed = false;
+    for (auto transaction : m_transactions) {
+        if (transaction->isUnconfirmed()) {
+            m_have_unconfirmed = true;
+            break;
+        }
+    }
+    emit transactionsChanged();
+}
+
 Wallet *Account::wallet() const
 {
     return m_wallet;
@@ -168,7 +196,7 @@ bool Account::isMainAccount() const
     return m_json.value("name").toString() == "";
 }
 
-void Account::exportCSV()
+ExportJob* Account::exportCSV()
 {
     const auto now = QDateTime::currentDateTime();
     const QString suggestion =
@@ -176,72 +204,54 @@ void Account::exportCSV()
             wallet()->name() + " - " + name() + " - " +
             now.toString("yyyyMMddhhmmss") + ".csv";
     const QString name = QFileDialog::getSaveFileName(nullptr, "Export to CSV", suggestion);
-    if (name.isEmpty()) return;
-
-    QFile file(name);
-    bool result = file.open(QFile::WriteOnly);
-    Q_ASSERT(result);
+    if (name.isEmpty()) return nullptr;
 
     const auto pricing = wallet()->settings().value("pricing").toObject();
-
-    const QString fee_field = QString("fee (%1)").arg(wallet()->network()->isLiquid() ? "L-" + wallet()->settings().value("unit").toString() : wallet()->settings().value("unit").toString());
-    const QString fiat_field = QString("fiat (%1 %2 %3)").arg(pricing.value("currency").toString()).arg(pricing.value("exchange").toString(), now.toString(Qt::ISODate));
-    const bool header = true;
-    const QString separator = ",";
-    const QStringList fields{"time", "description", "amount", "unit", fee_field, fiat_field, "txhash", "memo"};
-
-    QStringList lines;
-    if (header) {
-        lines.append(fields.join(separator));
-    }
+    const auto unit = wallet()->settings().value("unit").toString();
+    const bool is_liquid = wallet()->network()->isLiquid();
+
+    ExportJob::Options options;
+    options.format = ExportJob::Csv;
+    options.header = QStringList{
+        "time", "description", "amount", "unit",
+        QString("fee (%1)").arg(is_liquid ? "L-" + unit : unit),
+        QString("fiat (%1 %2 %3)").arg(pricing.value("currency").toString()).arg(pricing.value("exchange").toString(), now.toString(Qt::ISODate)),
+        "txhash", "memo"
+    };
+    options.fiat_rate = wallet()->m_fiat_rate.toDouble();
+    options.fee_decimals = Amount::decimals(unit);
+
+    // Only copy the data here, formatting and writing happen in the job.
+    QVector<ExportRow> rows;
+    rows.reserve(m_transactions.size());
     for (auto transaction : m_transactions) {
-        const auto data = transaction->data();
+        const auto& data = transaction->m_data;
         const auto block_height = data.value("block_height").toInt();
         if (block_height == 0) continue;
+        const auto type = data.value("type").toString();
         for (auto amount : transaction->m_amounts) {
             const auto asset = amount->asset();
-            QStringList values;
-            for (auto field : fields) {
-                if (field == "time") {
-                    values.append(data.value("created_at").toString());
-                } else if (field == "description") {
-                    values.append(data.value("type").toString());
-                } else if (field == "amount") {
-                    values.append(amount->formatAmount(false).replace(",", "."));
-                } else if (field == "unit") {
-                    if (asset && !asset->isLBTC()) {
-                        values.append(asset->data().value("ticker").toString());
-                    } else if (asset && asset->isLBTC()) {
-                        values.append("L-" + wallet()->settings().value("unit").toString());
-                    } else {
-                        values.append(wallet()->settings().value("unit").toString());
-                    }
-                } else if (field == fee_field) {
-                    if (data.value("type").toString() == "outgoing") {
-                        values.append(wallet()->formatAmount(data.value("fee").toInt(), false).replace(",", "."));
-                    } else {
-                        values.append("");
-                    }
-                } else if (field == fiat_field) {
-                    if (asset && !asset->isLBTC()) {
-                        values.append("");
-                    } else {
-                        values.append(wallet()->convert({{ "satoshi", amount->amount() }}).value("fiat").toString());
-                    }
-                } else if (field == "txhash") {
-                    values.append(data.value("txhash").toString());
-                } else if (field == "memo") {
-                    values.append(data.value("memo").toString().replace("\n", " ").replace(",", "-"));
-                } else {
-                    Q_UNREACHABLE();
-                }
-            }
-            lines.append(values.join(separator));
+            const bool is_btc = !asset || asset->isLBTC();
+            ExportRow row;
+            row.time = data.value("created_at").toString();
+            row.description = type;
+            row.unit = !is_btc ? asset->data().value("ticker").toString() : asset ? "L-" + unit : unit;
+            row.txhash = data.value("txhash").toString();
+            row.memo = data.value("memo").toString().replace("\n", " ").replace(",", "-");
+            row.amount = amount->amount();
+            row.decimals = is_btc ? Amount::decimals(unit) : asset->data().value("precision").toInt(0);
+            row.negative = type != "incoming";
+            row.trim = is_btc;
+            row.fiat = is_btc;
+            row.fee = type == "outgoing" ? data.value("fee").toInt() : -1;
+            rows.append(row);
         }
     }
 
-    QTextStream stream(&file);
-    stream << lines.join("\n");
+    auto job = new ExportJob(name, options, this);
+    QQmlEngine::setObjectOwnership(job, QQmlEngine::CppOwnership);
+    job->start(std::move(rows));
+    return job;
 }
 
 ReceiveAddress::ReceiveAddress(QObject *parent) : QObject(parent)
@@ -252,7 +262,7 @@ ReceiveAddress::ReceiveAddress(QObject *parent) : QObject(parent)
 ReceiveAddress::~ReceiveAddress()
 {
     if (m_account) {
-        QMetaObject::invokeMethod(m_account->m_wallet->m_context, [] {}, Qt::BlockingQueuedConnection);
+        m_account->m_wallet->m_context->run([] {});
     }
 }
 
@@ -328,7 +338,7 @@ void ReceiveAddress::generate()
 
     setGenerating(true);
 
-    QMetaObject::invokeMethod(m_account->m_wallet->m_context, [this] {
+    m_account->m_wallet->m_context->post([this] {
         auto result = GA::process_auth([this] (GA_auth_handler** call) {
             auto address_details = Json::fromObject({
                 { "subaccount", static_cast<qint64>(m_account->m_pointer) },
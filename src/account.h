@@ -5,6 +5,7 @@
 #include <QObject>
 
 class Balance;
+class ExportJob;
 class Transaction;
 class Wallet;
 
@@ -15,7 +16,6 @@ class Account : public QObject
     Q_PROPERTY(bool mainAccount READ isMainAccount NOTIFY jsonChanged)
     Q_PROPERTY(QJsonObject json READ json NOTIFY jsonChanged)
     Q_PROPERTY(QString name READ name NOTIFY jsonChanged)
-    Q_PROPERTY(QQmlListProperty<Transaction> transactions READ transactions NOTIFY transactionsChanged)
     Q_PROPERTY(qint64 balance READ balance NOTIFY balanceChanged)
     Q_PROPERTY(QQmlListProperty<Balance> balances READ balances NOTIFY balancesChanged)
     QML_ELEMENT
@@ -29,17 +29,19 @@ public:
     QString name() const;
     QJsonObject json() const;
 
-    QQmlListProperty<Transaction> transactions();
-
     void update(const QJsonObject& json);
 
-    void handleNotification(const QJsonObject &notification);
-
     qint64 balance() const;
 
     QQmlListProperty<Balance> balances();
 
     void updateBalance();
+    // Replaces the balance, as returned by GA_get_balance.
+    void setBalance(const QJsonObject& satoshi);
+
+    // Replaces the transaction list with the given transactions, newest
+    // first. Unless complete, previously loaded older transactions are kept.
+    void updateTransactions(const QJsonArray& transactions, bool complete);
 
 signals:
     void walletChanged();
@@ -50,15 +52,24 @@ signals:
     void balancesChanged();
 
 public slots:
+    // Fetches new transactions and refreshes the ones still unconfirmed.
     void reload();
-    void exportCSV();
+    // Fetches the whole transaction history.
+    void resync();
+    // Asks for a file and exports the confirmed transactions in the
+    // background, returns the running job or null if canceled.
+    ExportJob* exportCSV();
+
+private:
+    void fetchTransactions(bool full);
 
 public:
     Wallet* const m_wallet;
     QVector<Transaction*> m_transactions;
     QMap<QString, Transaction*> m_transactions_by_hash;
     QList<Balance*> m_balances;
-    QMap<QString, Balance*> m_balance_by_id;
+    // By asset index.
+    QHash<int, Balance*> m_balance_by_asset;
     bool m_have_unconfirmed{false};
     QJsonObject m_json;
     int m_pointer;
@@ -0,0 +1,113 @@
+#include "amount.h"
+
+#include <limits>
+
+namespace Amount {
+
+namespace {
+
+const qint64 POWERS_OF_TEN[] = {
+    1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL, 100000000LL,
+    1000000000LL, 10000000000LL, 100000000000LL, 1000000000000LL, 10000000000000LL,
+    100000000000000LL, 1000000000000000LL, 10000000000000000LL, 100000000000000000LL,
+    1000000000000000000LL
+};
+
+const int MAX_DECIMALS = sizeof(POWERS_OF_TEN) / sizeof(POWERS_OF_TEN[0]) - 1;
+
+QString fraction(quint64 value, int decimals, bool trim)
+{
+    QString digits = QString::number(value).rightJustified(decimals, '0');
+    if (trim) {
+        int size = digits.size();
+        while (size > 0 && digits.at(size - 1) == '0') --size;
+        digits.truncate(size);
+    }
+    return digits;
+}
+
+} // namespace
+
+QString unitKey(const QString& unit)
+{
+    return unit == "\u00B5BTC" ? "ubtc" : unit.toLower();
+}
+
+int decimals(const QString& unit)
+{
+    const auto key = unitKey(unit);
+    if (key == "btc") return 8;
+    if (key == "mbtc") return 5;
+    if (key == "ubtc" || key == "bits") return 2;
+    if (key == "sats") return 0;
+    return -1;
+}
+
+QString toString(qint64 satoshi, int decimals)
+{
+    Q_ASSERT(decimals >= 0 && decimals <= MAX_DECIMALS);
+    const bool negative = satoshi < 0;
+    const quint64 value = negative ? 0 - static_cast<quint64>(satoshi) : static_cast<quint64>(satoshi);
+    const quint64 power = static_cast<quint64>(POWERS_OF_TEN[decimals]);
+    QString str = QString::number(value / power);
+    if (decimals > 0) str += '.' + fraction(value % power, decimals, false);
+    return negative ? '-' + str : str;
+}
+
+QString format(qint64 satoshi, int decimals, const QLocale& locale, bool trim)
+{
+    Q_ASSERT(decimals >= 0 && decimals <= MAX_DECIMALS);
+    const bool negative = satoshi < 0;
+    const quint64 value = negative ? 0 - static_cast<quint64>(satoshi) : static_cast<quint64>(satoshi);
+    const quint64 power = static_cast<quint64>(POWERS_OF_TEN[decimals]);
+
+    QString str = locale.toString(static_cast<qulonglong>(value / power));
+    if (decimals > 0) {
+        QString digits = fraction(value % power, decimals, trim);
+        if (!digits.isEmpty()) {
+            const QChar zero = locale.zeroDigit();
+            if (zero != '0') {
+                for (auto& digit : digits) digit = QChar(zero.unicode() + digit.unicode() - '0');
+            }
+            str += locale.decimalPoint() + digits;
+        }
+    }
+    return negative ? locale.negativeSign() + str : str;
+}
+
+bool parse(const QString& amount, int decimals, qint64* satoshi)
+{
+    Q_ASSERT(satoshi);
+    if (decimals < 0 || decimals > MAX_DECIMALS) return false;
+
+    const QString str = amount.trimmed();
+    qint64 integer = 0;
+    qint64 fraction = 0;
+    int fraction_digits = 0;
+    int digits = 0;
+    bool separator = false;
+    const qint64 limit = std::numeric_limits<qint64>::max() / POWERS_OF_TEN[decimals];
+    for (const QChar c : str) {
+        if (c == '.' || c == ',') {
+            if (separator) return false;
+            separator = true;
+            continue;
+        }
+        if (c < '0' || c > '9') return false;
+        const int digit = c.unicode() - '0';
+        ++digits;
+        if (separator) {
+            if (++fraction_digits > decimals) return false;
+            fraction = fraction * 10 + digit;
+        } else {
+            if (integer > (limit - digit) / 10) return false;
+            integer = integer * 10 + digit;
+        }
+    }
+    if (digits == 0 || integer >= limit) return false;
+
+    *satoshi = integer * POWERS_OF_TEN[decimals] + fraction * POWERS_OF_TEN[decimals - fraction_digits];
+    return true;
+}
+
+} // namespace Amount
@@ -0,0 +1,30 @@
+#ifndef GREEN_AMOUNT_H
+#define GREEN_AMOUNT_H
+
+#include <QLocale>
+#include <QString>
+
+// Satoshi to unit conversions done with integer arithmetic, so that
+// formatting and parsing amounts doesn't need GA_convert_amount.
+namespace Amount {
+
+// Key used by GDK for the given display unit, e.g. "mBTC" -> "mbtc".
+QString unitKey(const QString& unit);
+
+// Number of decimal places of the given unit (display name or GDK key),
+// -1 if the unit is unknown.
+int decimals(const QString& unit);
+
+// Plain representation with all decimal places, e.g. "0.00100000".
+QString toString(qint64 satoshi, int decimals);
+
+// Locale aware representation without trailing zeros, unless trim is false.
+QString format(qint64 satoshi, int decimals, const QLocale& locale, bool trim = true);
+
+// Parses a non negative amount with at most the given decimal places,
+// accepting both '.' and ',' as decimal separator.
+bool parse(const QString& amount, int decimals, qint64* satoshi);
+
+} // namespace Amount
+
+#endif // GREEN_AMOUNT_H
@@ -0,0 +1,54 @@
+#include "apdu.h"
+
+namespace Apdu {
+
+void frame(const QByteArray& apdu, int prefix, QByteArray& out)
+{
+    const int report_size = prefix + HID_REPORT_SIZE;
+    const int count = reportCount(apdu.size());
+    out.resize(count * report_size);
+    out.fill(0);
+
+    int offset = 0;
+    for (int index = 0; index < count; ++index) {
+        Writer writer(out.data() + index * report_size + prefix, HID_REPORT_SIZE);
+        writer.be(CHANNEL_DEFAULT_ID).u8(TAG_APDU).be(static_cast<quint16>(index));
+        if (index == 0) writer.be(static_cast<quint16>(apdu.size()));
+        const int size = qMin(apdu.size() - offset, HID_REPORT_SIZE - writer.size());
+        writer.bytes(apdu.constData() + offset, size);
+        offset += size;
+    }
+}
+
+Assembler::Result Assembler::add(const char* report, int size)
+{
+    Reader reader(report, size);
+    const auto channel_id = reader.be16();
+    const auto tag = reader.u8();
+    const auto index = reader.be16();
+    if (!reader.ok() || channel_id != CHANNEL_DEFAULT_ID || tag != TAG_APDU) return Invalid;
+
+    if (index == 0) {
+        m_remaining = reader.be16();
+        m_next_index = 0;
+        m_response.resize(0);
+        m_response.reserve(m_remaining);
+    } else if (index != m_next_index || m_remaining == 0) {
+        return Invalid;
+    }
+
+    const int chunk = qMin(m_remaining, reader.remaining());
+    m_response.append(reader.bytes(chunk), chunk);
+    m_remaining -= chunk;
+    m_next_index = index + 1;
+    return m_remaining > 0 ? Incomplete : Complete;
+}
+
+void Assembler::clear()
+{
+    m_response.resize(0);
+    m_remaining = 0;
+    m_next_index = 0;
+}
+
+} // namespace Apdu
@@ -0,0 +1,180 @@
+#ifndef GREEN_APDU_H
+#define GREEN_APDU_H
+
+#include <QByteArray>
+#include <QtEndian>
+
+#include <cstring>
+
+// Building of Ledger APDUs and their HID framing on fixed buffers, without
+// QDataStream and without intermediate allocations.
+namespace Apdu {
+
+const int HEADER_SIZE = 5;
+const int HID_REPORT_SIZE = 64;
+const quint16 CHANNEL_DEFAULT_ID = 0x0101;
+const quint8 TAG_APDU = 0x05;
+
+// Sequential writer over a caller provided buffer, writing past the end is
+// a programming error.
+class Writer
+{
+public:
+    Writer(char* data, int capacity) : m_data(data), m_capacity(capacity) {}
+
+    int size() const { return m_size; }
+
+    Writer& u8(quint8 value)
+    {
+        Q_ASSERT(m_size < m_capacity);
+        m_data[m_size++] = static_cast<char>(value);
+        return *this;
+    }
+    template <typename T>
+    Writer& be(T value)
+    {
+        Q_ASSERT(m_size + static_cast<int>(sizeof(T)) <= m_capacity);
+        qToBigEndian(value, m_data + m_size);
+        m_size += sizeof(T);
+        return *this;
+    }
+    template <typename T>
+    Writer& le(T value)
+    {
+        Q_ASSERT(m_size + static_cast<int>(sizeof(T)) <= m_capacity);
+        qToLittleEndian(value, m_data + m_size);
+        m_size += sizeof(T);
+        return *this;
+    }
+    Writer& bytes(const char* data, int size)
+    {
+        Q_ASSERT(m_size + size <= m_capacity);
+        std::memcpy(m_data + m_size, data, size);
+        m_size += size;
+        return *this;
+    }
+    Writer& bytes(const QByteArray& data) { return bytes(data.constData(), data.size()); }
+    // Bitcoin compact size, little endian.
+    Writer& varint(quint64 value)
+    {
+        if (value < 0xfd) return u8(static_cast<quint8>(value));
+        if (value <= 0xffff) return u8(0xfd).le(static_cast<quint16>(value));
+        if (value <= 0xffffffff) return u8(0xfe).le(static_cast<quint32>(value));
+        return u8(0xff).le(value);
+    }
+
+    static int varintSize(quint64 value)
+    {
+        return value < 0xfd ? 1 : value <= 0xffff ? 3 : value <= 0xffffffff ? 5 : 9;
+    }
+
+private:
+    char* const m_data;
+    const int m_capacity;
+    int m_size{0};
+};
+
+// Sequential reader over a buffer, reads past the end return zeros and
+// clear ok().
+class Reader
+{
+public:
+    Reader(const char* data, int size) : m_data(data), m_size(size) {}
+    explicit Reader(const QByteArray& data) : Reader(data.constData(), data.size()) {}
+
+    bool ok() const { return m_ok; }
+    int remaining() const { return m_size - m_offset; }
+
+    quint8 u8()
+    {
+        if (!check(1)) return 0;
+        return static_cast<quint8>(m_data[m_offset++]);
+    }
+    quint16 be16()
+    {
+        if (!check(2)) return 0;
+        const auto value = qFromBigEndian<quint16>(m_data + m_offset);
+        m_offset += 2;
+        return value;
+    }
+    // Returns a pointer to the next size bytes, or null.
+    const char* bytes(int size)
+    {
+        if (!check(size)) return nullptr;
+        const char* data = m_data + m_offset;
+        m_offset += size;
+        return data;
+    }
+
+private:
+    bool check(int size)
+    {
+        if (m_offset + size <= m_size) return true;
+        m_ok = false;
+        return false;
+    }
+
+    const char* const m_data;
+    const int m_size;
+    int m_offset{0};
+    bool m_ok{true};
+};
+
+// Command APDU of a given instruction, built with a single allocation.
+template <quint8 CLA, quint8 INS>
+struct Instruction
+{
+    static QByteArray build(quint8 p1, quint8 p2, const char* data, int size)
+    {
+        Q_ASSERT(size < 256);
+        QByteArray apdu(HEADER_SIZE + size, Qt::Uninitialized);
+        Writer(apdu.data(), apdu.size()).u8(CLA).u8(INS).u8(p1).u8(p2).u8(static_cast<quint8>(size)).bytes(data, size);
+        return apdu;
+    }
+    static QByteArray build(quint8 p1, quint8 p2, const QByteArray& data = QByteArray())
+    {
+        return build(p1, p2, data.constData(), data.size());
+    }
+};
+
+using GetAppName = Instruction<0xb0, 0x01>;
+using GetFirmwareVersion = Instruction<0xe0, 0xc4>;
+using GetWalletPublicKey = Instruction<0xe0, 0x40>;
+using HashInputStart = Instruction<0xe0, 0x44>;
+using HashSign = Instruction<0xe0, 0x48>;
+using HashInputFinalizeFull = Instruction<0xe0, 0x4a>;
+using SignMessage = Instruction<0xe0, 0x4e>;
+
+// Number of HID reports carrying an APDU of the given size, the first
+// report has 7 bytes of header and the following ones 5.
+inline int reportCount(int size)
+{
+    const int first = HID_REPORT_SIZE - 7;
+    const int next = HID_REPORT_SIZE - 5;
+    return size <= first ? 1 : 1 + (size - first + next - 1) / next;
+}
+
+// Writes the HID reports of an APDU into out, each report preceded by
+// prefix zero bytes (the report id where the platform needs it). The
+// reports are contiguous, of HID_REPORT_SIZE + prefix bytes each.
+void frame(const QByteArray& apdu, int prefix, QByteArray& out);
+
+// Reassembles HID reports into an APDU response.
+class Assembler
+{
+public:
+    enum Result { Incomplete, Complete, Invalid };
+    Result add(const char* report, int size);
+    // The complete response, including the status word.
+    const QByteArray& response() const { return m_response; }
+    void clear();
+
+private:
+    QByteArray m_response;
+    int m_remaining{0};
+    int m_next_index{0};
+};
+
+} // namespace Apdu
+
+#endif // GREEN_APDU_H
@@ -1,64 +1,80 @@
+#include "amount.h"
 #include "asset.h"
+#include "asseticonprovider.h"
 #include "wallet.h"
 
 #include <QDesktopServices>
 #include <QLocale>
 #include <QUrl>
-#include <QtMath>
 
-Asset::Asset(const QString& id, Wallet* wallet)
+Asset::Asset(const QString& id, int index, Wallet* wallet)
     : QObject(wallet)
     , m_wallet(wallet)
     , m_id(id)
+    , m_index(index)
 {
+    updateSortKey();
 }
 
-void Asset::setIcon(const QString &icon)
+QString Asset::icon() const
 {
-    if (m_icon == icon) return;
-    m_icon = icon;
-    emit iconChanged();
+    if (!m_has_icon) return {};
+    return QStringLiteral("image://asset/%1?%2").arg(m_id).arg(m_icon_revision);
 }
 
-QString Asset::name() const
+void Asset::setIcon(const QByteArray& icon)
 {
-    auto name = m_data.value("name").toString();
-    if (name.isEmpty()) return m_id;
-    if (name == "btc") return "Liquid Bitcoin";
-    return name;
+    // Other wallets may have registered the same icon already.
+    const bool replaced = AssetIconProvider::insert(m_id, icon);
+    if (m_has_icon && !replaced) return;
+    m_has_icon = true;
+    ++m_icon_revision;
+    updateSortKey();
+    emit iconChanged();
 }
 
 void Asset::setData(const QJsonObject &data)
 {
     if (m_data == data) return;
     m_data = data;
+    updateSortKey();
     emit dataChanged();
 }
 
+bool Asset::lessThan(const Asset* a1, const Asset* a2)
+{
+    if (a1->m_sort_rank != a2->m_sort_rank) return a1->m_sort_rank < a2->m_sort_rank;
+    return a1->m_name < a2->m_name;
+}
+
+void Asset::updateSortKey()
+{
+    const auto name = m_data.value("name").toString();
+    m_is_lbtc = name == "btc";
+    m_name = name.isEmpty() ? m_id : m_is_lbtc ? "Liquid Bitcoin" : name;
+    m_sort_rank = m_is_lbtc ? 0 : m_has_icon ? 1 : hasData() ? 2 : 3;
+}
+
 qint64 Asset::parseAmount(const QString& amount) const
 {
-    if (m_data.value("name").toString() == "btc") {
+    if (m_is_lbtc) {
         return wallet()->amountToSats(amount);
     }
 
-    QString sanitized_amount = amount;
-    sanitized_amount.replace(',', '.');
-    auto precision = m_data.value("precision").toInt(0);
-    bool ok;
-    double result = sanitized_amount.toDouble(&ok);
-    if (!ok) return 0;
-    result *= qPow(10, precision);
+    const auto precision = m_data.value("precision").toInt(0);
+    qint64 result;
+    if (!Amount::parse(amount, precision, &result)) return 0;
     return result;
 }
 
 QString Asset::formatAmount(qint64 amount, bool include_ticker) const
 {
-    if (m_data.value("name").toString() == "btc") {
+    if (m_is_lbtc) {
         return wallet()->formatAmount(amount, include_ticker);
     }
 
-    auto precision = m_data.value("precision").toInt(0);
-    auto str = QLocale::system().toString(static_cast<double>(amount) / qPow(10, precision), 'f', precision);
+    const auto precision = m_data.value("precision").toInt(0);
+    auto str = Amount::format(amount, precision, QLocale::system(), /* trim = */ false);
 
     if (include_ticker) {
         auto ticker = m_data.value("ticker").toString();
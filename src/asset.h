@@ -20,18 +20,22 @@ class Asset : public QObject
     QML_ELEMENT
     QML_UNCREATABLE("Asset is instanced by Wallet.")
 public:
-    explicit Asset(const QString& id, Wallet* wallet);
+    Asset(const QString& id, int index, Wallet* wallet);
 
     Wallet* wallet() const { return m_wallet; }
     QString id() const { return m_id; }
+    // Position in the asset table of the wallet, see Wallet::assetIndex.
+    int index() const { return m_index; }
 
-    bool isLBTC() const { return m_data.value("name").toString() == "btc"; }
+    bool isLBTC() const { return m_is_lbtc; }
 
-    bool hasIcon() const { return !m_icon.isEmpty(); }
-    QString icon() const { return m_icon; }
-    void setIcon(const QString& icon);
+    bool hasIcon() const { return m_has_icon; }
+    // Image URL of the icon, see AssetIconProvider.
+    QString icon() const;
+    // PNG of the icon.
+    void setIcon(const QByteArray& icon);
 
-    QString name() const;
+    QString name() const { return m_name; }
 
     bool hasData() const { return !m_data.isEmpty(); }
     QJsonObject data() const { return m_data; }
@@ -40,6 +44,10 @@ public:
     Q_INVOKABLE qint64 parseAmount(const QString& amount) const;
     Q_INVOKABLE QString formatAmount(qint64 amount, bool include_ticker) const;
 
+    // Orders L-BTC first, then assets with icon, then assets with metadata,
+    // each by name.
+    static bool lessThan(const Asset* a1, const Asset* a2);
+
 public slots:
     void openInExplorer() const;
 
@@ -48,10 +56,20 @@ signals:
     void dataChanged();
 
 private:
+    void updateSortKey();
+
     Wallet* const m_wallet;
     QString const m_id;
-    QString m_icon;
+    int const m_index;
+    bool m_has_icon{false};
+    // Changes the icon URL when the icon is replaced.
+    int m_icon_revision{0};
     QJsonObject m_data;
+    // Derived from the data and the icon, these are compared a lot when
+    // sorting balances.
+    bool m_is_lbtc{false};
+    QString m_name;
+    int m_sort_rank{0};
 };
 
 #endif // GREEN_ASSET_H
@@ -0,0 +1,130 @@
+#include "assetcache.h"
+#include "network.h"
+#include "util.h"
+
+#include <QCborArray>
+#include <QCborMap>
+#include <QCborValue>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <cstring>
+
+namespace {
+
+const char MAGIC[4] = { 'G', 'A', 'S', 'C' };
+const quint32 VERSION = 1;
+const int HEADER_SIZE = sizeof(MAGIC) + sizeof(quint32);
+
+// The registry changes rarely, wallets opened within this interval of the
+// last download use the cache as is.
+const qint64 REFRESH_INTERVAL = 24 * 60 * 60 * 1000;
+
+} // namespace
+
+AssetCache::AssetCache(Network* network)
+    : m_file_name(GetDataFile("assets", network->id()))
+{
+}
+
+AssetCache::Entries AssetCache::load()
+{
+    Entries entries;
+    if (m_loaded) return entries;
+    m_loaded = true;
+
+    QFile file(m_file_name);
+    if (!file.open(QFile::ReadOnly)) return entries;
+    const auto data = file.readAll();
+    if (data.size() < HEADER_SIZE ||
+            memcmp(data.constData(), MAGIC, sizeof(MAGIC)) != 0 ||
+            qFromLittleEndian<quint32>(data.constData() + sizeof(MAGIC)) != VERSION) {
+        return entries;
+    }
+
+    QCborParserError error;
+    const auto map = QCborValue::fromCbor(data.mid(HEADER_SIZE), &error).toMap();
+    if (error.error != QCborError::NoError) return entries;
+
+    m_refreshed_at = map.value(QStringLiteral("refreshed_at")).toInteger();
+    for (const auto& value : map.value(QStringLiteral("assets")).toArray()) {
+        const auto record = value.toArray();
+        const auto id = record.at(0).toString();
+        if (id.isEmpty()) continue;
+        Entry entry{ record.at(1).toJsonValue().toObject(), record.at(2).toByteArray() };
+        m_digests.insert(id, digest(entry));
+        entries.insert(id, entry);
+    }
+    return entries;
+}
+
+bool AssetCache::isStale() const
+{
+    return QDateTime::currentMSecsSinceEpoch() - m_refreshed_at >= REFRESH_INTERVAL;
+}
+
+AssetCache::Entries AssetCache::update(const QJsonObject& assets, const QJsonObject& icons)
+{
+    Entries entries;
+    for (auto i = assets.constBegin(); i != assets.constEnd(); ++i) {
+        const auto data = i.value().toObject();
+        const auto id = data.value("asset_id").toString();
+        if (id.isEmpty()) continue;
+        entries.insert(id, { data, QByteArray::fromBase64(icons.value(id).toString().toLatin1()) });
+    }
+
+    Entries changed;
+    QHash<QString, QByteArray> digests;
+    for (auto i = entries.constBegin(); i != entries.constEnd(); ++i) {
+        const auto value = digest(i.value());
+        if (m_digests.value(i.key()) != value) changed.insert(i.key(), i.value());
+        digests.insert(i.key(), value);
+    }
+
+    m_digests = digests;
+    m_refreshed_at = QDateTime::currentMSecsSinceEpoch();
+    save(entries);
+    return changed;
+}
+
+void AssetCache::reset()
+{
+    m_loaded = false;
+    m_refreshed_at = 0;
+    m_digests.clear();
+}
+
+QByteArray AssetCache::digest(const Entry& entry)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(QCborValue::fromJsonValue(entry.data).toCbor());
+    hash.addData(entry.icon);
+    return hash.result();
+}
+
+// Layout: "GASC", u32 version little endian, then a CBOR map with the time
+// of the last download and an array of [id, metadata, icon] records.
+void AssetCache::save(const Entries& entries) const
+{
+    QCborArray records;
+    for (auto i = entries.constBegin(); i != entries.constEnd(); ++i) {
+        records.append(QCborArray{ i.key(), QCborValue::fromJsonValue(i.value().data), i.value().icon });
+    }
+    QCborMap map;
+    map.insert(QStringLiteral("refreshed_at"), m_refreshed_at);
+    map.insert(QStringLiteral("assets"), records);
+
+    QByteArray data(MAGIC, sizeof(MAGIC));
+    uchar version[sizeof(quint32)];
+    qToLittleEndian(VERSION, version);
+    data.append(reinterpret_cast<const char*>(version), sizeof(version));
+    data.append(map.toCborValue().toCbor());
+
+    QSaveFile file(m_file_name);
+    if (!file.open(QFile::WriteOnly)) return;
+    file.write(data);
+    file.commit();
+}
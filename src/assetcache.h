@@ -0,0 +1,55 @@
+#ifndef GREEN_ASSETCACHE_H
+#define GREEN_ASSETCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonObject>
+#include <QString>
+
+class Network;
+
+// Local copy of the Liquid asset registry of a network, metadata and icons,
+// so that wallets show assets without waiting for the registry download.
+//
+// The registry is downloaded at most once per refresh interval. The time of
+// the last download is read from the file when the cache is loaded, so a
+// wallet logging in after another one of the same network downloaded the
+// registry uses the cache as is. Each asset is validated with a digest of
+// its metadata and icon, so that a download only reports the assets that
+// actually changed.
+//
+// Not thread safe, meant to be used from the tasks of a wallet executor.
+class AssetCache
+{
+public:
+    struct Entry {
+        QJsonObject data;
+        // PNG, empty if the registry has no icon for the asset.
+        QByteArray icon;
+    };
+    using Entries = QHash<QString, Entry>;
+
+    explicit AssetCache(Network* network);
+
+    // Reads the file, returns all cached assets the first time and nothing
+    // afterwards.
+    Entries load();
+    // True if the registry wasn't downloaded within the refresh interval.
+    bool isStale() const;
+    // Replaces the cache with the output of GA_refresh_assets and returns
+    // the assets that were added or changed since the last load or update.
+    Entries update(const QJsonObject& assets, const QJsonObject& icons);
+    // Forgets what was loaded, the next load reads the file again.
+    void reset();
+
+private:
+    static QByteArray digest(const Entry& entry);
+    void save(const Entries& entries) const;
+
+    const QString m_file_name;
+    bool m_loaded{false};
+    qint64 m_refreshed_at{0};
+    QHash<QString, QByteArray> m_digests;
+};
+
+#endif // GREEN_ASSETCACHE_H
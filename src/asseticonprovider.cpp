@@ -0,0 +1,119 @@
+#include "asseticonprovider.h"
+#include "trace.h"
+
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QThreadPool>
+
+namespace {
+
+// Cost of decoded images in KiB.
+const int IMAGE_CACHE_SIZE = 16 * 1024;
+
+QMutex g_mutex;
+// PNG of each asset icon.
+QHash<QString, QByteArray> g_icons;
+// Decoded images by asset id and size.
+QCache<QString, QImage> g_images(IMAGE_CACHE_SIZE);
+
+QString imageKey(const QString& id, const QSize& size)
+{
+    return QStringLiteral("%1@%2x%3").arg(id).arg(size.width()).arg(size.height());
+}
+
+} // namespace
+
+bool AssetIconProvider::insert(const QString& id, const QByteArray& icon)
+{
+    QMutexLocker locker(&g_mutex);
+    if (g_icons.value(id) == icon) return false;
+    g_icons.insert(id, icon);
+    const auto prefix = id + '@';
+    for (const auto& key : g_images.keys()) {
+        if (key.startsWith(prefix)) g_images.remove(key);
+    }
+    return true;
+}
+
+QQuickImageResponse* AssetIconProvider::requestImageResponse(const QString& id, const QSize& requested_size)
+{
+    // The query is only a revision to bypass the QML pixmap cache.
+    return new AssetIconResponse(id.section('?', 0, 0), requested_size);
+}
+
+AssetIconLoader::AssetIconLoader(const QString& id, const QSize& requested_size, const QSharedPointer<QAtomicInt>& canceled)
+    : m_id(id)
+    , m_requested_size(requested_size)
+    , m_canceled(canceled)
+{
+}
+
+void AssetIconLoader::run()
+{
+    if (m_canceled->loadRelaxed()) return;
+
+    const auto key = imageKey(m_id, m_requested_size);
+    QByteArray icon;
+    {
+        QMutexLocker locker(&g_mutex);
+        if (auto image = g_images.object(key)) {
+            emit done(*image);
+            return;
+        }
+        icon = g_icons.value(m_id);
+    }
+
+    QImage image;
+    if (!icon.isEmpty()) {
+        Trace::Scope trace("asset icon decode", icon.size());
+        image = QImage::fromData(icon, "PNG");
+        if (!image.isNull() && m_requested_size.isValid()) {
+            image = image.scaled(m_requested_size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+    }
+
+    if (!image.isNull()) {
+        QMutexLocker locker(&g_mutex);
+        // Skip images of icons replaced while decoding.
+        if (g_icons.value(m_id) == icon) {
+            g_images.insert(key, new QImage(image), qMax(1, static_cast<int>(image.sizeInBytes() / 1024)));
+        }
+    }
+    emit done(image);
+}
+
+AssetIconResponse::AssetIconResponse(const QString& id, const QSize& requested_size)
+    : m_id(id)
+    , m_canceled(new QAtomicInt)
+{
+    auto loader = new AssetIconLoader(id, requested_size, m_canceled);
+    connect(loader, &AssetIconLoader::done, this, &AssetIconResponse::finish, Qt::QueuedConnection);
+    QThreadPool::globalInstance()->start(loader);
+}
+
+QQuickTextureFactory* AssetIconResponse::textureFactory() const
+{
+    return QQuickTextureFactory::textureFactoryForImage(m_image);
+}
+
+QString AssetIconResponse::errorString() const
+{
+    return m_image.isNull() ? QStringLiteral("No icon for asset %1").arg(m_id) : QString();
+}
+
+// Canceled responses still have to emit finished for the engine to delete
+// them, the image of the loader is then ignored.
+void AssetIconResponse::cancel()
+{
+    m_canceled->storeRelaxed(1);
+    finish({});
+}
+
+void AssetIconResponse::finish(const QImage& image)
+{
+    if (m_finished) return;
+    m_finished = true;
+    m_image = image;
+    emit finished();
+}
@@ -0,0 +1,58 @@
+#ifndef GREEN_ASSETICONPROVIDER_H
+#define GREEN_ASSETICONPROVIDER_H
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QQuickAsyncImageProvider>
+#include <QRunnable>
+#include <QSharedPointer>
+
+// Serves asset icons as image://asset/<id>. The PNG of each icon is kept
+// once, shared by all wallets, and is decoded on a pool thread at the
+// requested size, which QML already scales by the device pixel ratio.
+// Decoded images are kept in a bounded least recently used cache so that
+// scrolling asset lists doesn't decode the same icons again.
+class AssetIconProvider : public QQuickAsyncImageProvider
+{
+public:
+    // Thread safe, returns false if the asset already had the same icon.
+    static bool insert(const QString& id, const QByteArray& icon);
+
+    QQuickImageResponse* requestImageResponse(const QString& id, const QSize& requested_size) override;
+};
+
+// Decodes an icon on a pool thread. The engine may delete the response at
+// any time, so the loader only shares the cancel flag with it and hands the
+// image over with a queued signal.
+class AssetIconLoader : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    AssetIconLoader(const QString& id, const QSize& requested_size, const QSharedPointer<QAtomicInt>& canceled);
+    void run() override;
+signals:
+    void done(const QImage& image);
+private:
+    const QString m_id;
+    const QSize m_requested_size;
+    const QSharedPointer<QAtomicInt> m_canceled;
+};
+
+class AssetIconResponse : public QQuickImageResponse
+{
+    Q_OBJECT
+public:
+    AssetIconResponse(const QString& id, const QSize& requested_size);
+    QQuickTextureFactory* textureFactory() const override;
+    QString errorString() const override;
+    void cancel() override;
+private:
+    void finish(const QImage& image);
+
+    const QString m_id;
+    const QSharedPointer<QAtomicInt> m_canceled;
+    QImage m_image;
+    bool m_finished{false};
+};
+
+#endif // GREEN_ASSETICONPROVIDER_H
@@ -13,17 +13,23 @@ Balance::Balance(Account* account)
     connect(m_account->wallet(), &Wallet::settingsChanged, this, &Balance::changed);
 }
 
-void Balance::setAsset(Asset* asset)
+Asset* Balance::asset() const
+{
+    return m_asset_index < 0 ? nullptr : m_account->wallet()->asset(m_asset_index);
+}
+
+void Balance::setAssetIndex(int index)
 {
     // Either it's the first call or asset can't change
-    Q_ASSERT(!m_asset || m_asset == asset);
-    if (m_asset == asset) return;
-    m_asset = asset;
-    emit assetChanged(m_asset);
+    Q_ASSERT(m_asset_index < 0 || m_asset_index == index);
+    if (m_asset_index == index) return;
+    m_asset_index = index;
+    auto asset = this->asset();
+    emit assetChanged(asset);
     emit changed();
 
     // Asset might not be loaded
-    connect(m_asset, &Asset::dataChanged, this, &Balance::changed);
+    connect(asset, &Asset::dataChanged, this, &Balance::changed);
 }
 
 void Balance::setAmount(qint64 amount)
@@ -35,12 +41,12 @@ void Balance::setAmount(qint64 amount)
 
 QString Balance::displayAmount() const
 {
-    Q_ASSERT(m_asset);
-    return m_asset->formatAmount(m_amount, /* include_ticker = */ true);
+    Q_ASSERT(m_asset_index >= 0);
+    return asset()->formatAmount(m_amount, /* include_ticker = */ true);
 }
 
 QString Balance::inputAmount() const
 {
-    Q_ASSERT(m_asset);
-    return m_asset->formatAmount(m_amount, /* include_ticker = */ false);
+    Q_ASSERT(m_asset_index >= 0);
+    return asset()->formatAmount(m_amount, /* include_ticker = */ false);
 }
@@ -22,8 +22,9 @@ public:
 
     Account* account() const { return m_account; }
 
-    Asset* asset() const { return m_asset; }
-    void setAsset(Asset* asset);
+    Asset* asset() const;
+    int assetIndex() const { return m_asset_index; }
+    void setAssetIndex(int index);
 
     qint64 amount() const { return m_amount; }
     void setAmount(qint64 amount);
@@ -37,7 +38,8 @@ signals:
 
 private:
     Account* const m_account;
-    Asset* m_asset{nullptr};
+    // Index in the asset table of the wallet.
+    int m_asset_index{-1};
     qint64 m_amount{0};
 };
 
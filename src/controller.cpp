@@ -1,5 +1,6 @@
 #include "controller.h"
 #include "device.h"
+#include "executor.h"
 #include "handler.h"
 #include "json.h"
 #include "wallet.h"
@@ -108,27 +109,21 @@ void Controller::exec(Handler* handler)
     connect(handler, &Handler::requestCode, [this, handler] { emit requestCode(handler); });
     connect(handler, &Handler::resolveCode, [this, handler] { emit resolveCode(handler); });
     connect(handler, &Handler::invalidCode, [this, handler] { emit invalidCode(handler); });
-    QMetaObject::invokeMethod(context(), [this, handler] {
+    handler->m_context = context();
+    context()->post([this, handler] {
         handler->init(session());
-        QMetaObject::invokeMethod(this, [handler] {
-            handler->exec();
-        }, Qt::QueuedConnection);
-    }, Qt::QueuedConnection);
+        handler->exec();
+    });
 
 
     connect(handler, &Handler::resolveCode, [this, handler] {
         const auto action = handler->result().value("action").toString();
         if (action == "get_xpubs") {
-            for (auto path : handler->m_paths) {
-                auto cmd = new GetWalletPublicKeyCommand(wallet()->network(), path);
-                connect(cmd, &Command::finished, [cmd, handler] {
-                    handler->m_xpubs.append(cmd->m_xpub);
-                    if (handler->m_xpubs.size() == handler->m_paths.size()) {
-                        handler->resolve({{ "xpubs", handler->m_xpubs }});
-                    }
-                });
-                wallet()->m_device->exchange(cmd);
-            }
+            wallet()->m_device->getXPubs(wallet()->network(), handler->m_paths, [handler](const QJsonArray& xpubs) {
+                handler->resolve({{ "xpubs", xpubs }});
+            }, [handler] {
+                handler->fail("Getting the public keys from the device failed");
+            });
             return;
         }
 
@@ -136,7 +131,17 @@ void Controller::exec(Handler* handler)
             Q_ASSERT(wallet()->m_device);
 
             auto required_data = handler->result().value("required_data").toObject();
-            auto command = wallet()->m_device->signTransaction(required_data);
+            auto device = wallet()->m_device;
+            auto command = device->signTransaction(required_data);
+            command->setParent(handler);
+            // Stop signing if the handler goes away, e.g. the dialog is closed.
+            const auto token = command->token;
+            connect(handler, &QObject::destroyed, device, [device, token] {
+                device->cancel(token);
+            });
+            connect(command, &Command::error, handler, [handler] {
+                handler->fail("Signing on the device failed");
+            });
             connect(command, &Command::finished, [command, handler] {
                 QJsonArray signatures;
                 for (const auto& signature : command->signatures) {
@@ -149,7 +154,7 @@ void Controller::exec(Handler* handler)
     });
 }
 
-QObject* Controller::context() const
+Executor* Controller::context() const
 {
     Wallet* w = wallet();
     return w ? w->m_context : nullptr;
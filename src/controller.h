@@ -6,6 +6,7 @@
 
 #include "ga.h"
 
+class Executor;
 class Handler;
 class Wallet;
 
@@ -19,7 +20,7 @@ public:
 
     void exec(Handler* handler);
 
-    QObject* context() const;
+    Executor* context() const;
     GA_session* session() const;
 
     Wallet* wallet() const;
@@ -0,0 +1,395 @@
+#include "account.h"
+#include "amount.h"
+#include "asset.h"
+#include "balance.h"
+#include "daemon.h"
+#include "executor.h"
+#include "ga.h"
+#include "handler.h"
+#include "json.h"
+#include "network.h"
+#include "sendtransactioncontroller.h"
+#include "util.h"
+#include "wallet.h"
+#include "walletmanager.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QSharedPointer>
+#include <QTimer>
+
+#include <gdk.h>
+
+namespace {
+
+// JSON-RPC 2.0 error codes.
+const int PARSE_ERROR = -32700;
+const int INVALID_REQUEST = -32600;
+const int METHOD_NOT_FOUND = -32601;
+const int INVALID_PARAMS = -32602;
+const int SERVER_ERROR = -32000;
+
+// Requests longer than this are rejected and the client is disconnected.
+const qint64 MAX_REQUEST_SIZE = 1024 * 1024;
+
+// Transactions not created, or sent, within this time are reported as
+// failed.
+const int TRANSACTION_TIMEOUT = 2 * 60 * 1000;
+
+} // namespace
+
+int Daemon::exec(QCoreApplication& app)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Green wallet daemon");
+    parser.addHelpOption();
+    parser.addOption({ "daemon", "Run without user interface." });
+    parser.addOption({ "socket", "Path of the JSON-RPC socket.", "path", GetDataFile("app", "daemon.sock") });
+    parser.addOption({ "pin-file", "JSON file mapping wallet ids or names to PINs, must only be readable by the owner.", "path" });
+    parser.process(app);
+
+    if (!parser.isSet("pin-file")) {
+        qCritical() << "missing --pin-file";
+        return 1;
+    }
+
+    Daemon daemon;
+    QString error;
+    if (!daemon.loadPins(parser.value("pin-file"), &error) || !daemon.listen(parser.value("socket"), &error)) {
+        qCritical().noquote() << error;
+        return 1;
+    }
+    daemon.login();
+    return app.exec();
+}
+
+Daemon::Daemon(QObject* parent)
+    : QObject(parent)
+    , m_server(new QLocalServer(this))
+{
+    connect(m_server, &QLocalServer::newConnection, this, [this] {
+        while (auto socket = m_server->nextPendingConnection()) {
+            handleConnection(socket);
+        }
+    });
+}
+
+bool Daemon::loadPins(const QString& path, QString* error)
+{
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly)) {
+        *error = QString("can't open %1: %2").arg(path, file.errorString());
+        return false;
+    }
+#ifndef Q_OS_WIN
+    const auto shared = QFile::ReadGroup | QFile::WriteGroup | QFile::ReadOther | QFile::WriteOther;
+    if (file.permissions() & shared) {
+        *error = QString("%1 must only be accessible by its owner").arg(path);
+        return false;
+    }
+#endif
+    QJsonParseError parse_error;
+    const auto doc = QJsonDocument::fromJson(file.readAll(), &parse_error);
+    if (parse_error.error != QJsonParseError::NoError || !doc.isObject()) {
+        *error = QString("%1 is not a JSON object").arg(path);
+        return false;
+    }
+    const auto pins = doc.object();
+    for (auto wallet : WalletManager::instance()->m_wallets) {
+        auto pin = pins.value(wallet->m_id);
+        if (pin.isUndefined()) pin = pins.value(wallet->name());
+        if (!pin.isString()) continue;
+        m_pins.insert(wallet, pin.toString().toLatin1());
+    }
+    if (m_pins.isEmpty()) {
+        *error = QString("%1 doesn't match any wallet").arg(path);
+        return false;
+    }
+    return true;
+}
+
+bool Daemon::listen(const QString& path, QString* error)
+{
+    QLocalServer::removeServer(path);
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_server->listen(path)) {
+        *error = QString("can't listen on %1: %2").arg(path, m_server->errorString());
+        return false;
+    }
+    qInfo().noquote() << "listening on" << m_server->fullServerName();
+    return true;
+}
+
+void Daemon::login()
+{
+    for (auto i = m_pins.constBegin(); i != m_pins.constEnd(); ++i) {
+        Wallet* wallet = i.key();
+        const QByteArray pin = i.value();
+        // Nobody is around to move the mouse.
+        wallet->m_auto_logout = false;
+        // Log in on every connection, but a wrong PIN is not retried since
+        // each attempt counts towards locking the wallet.
+        const int attempts = wallet->loginAttemptsRemaining();
+        QObject::connect(wallet, &Wallet::connectionChanged, this, [wallet, pin, attempts] {
+            if (wallet->connection() != Wallet::Connected) return;
+            if (wallet->authentication() != Wallet::Unauthenticated) return;
+            if (wallet->loginAttemptsRemaining() < attempts) return;
+            wallet->loginWithPin(pin);
+        }, Qt::QueuedConnection);
+        QObject::connect(wallet, &Wallet::authenticationChanged, this, [wallet, attempts] {
+            if (wallet->authentication() == Wallet::Authenticated) {
+                qInfo().noquote() << "logged in" << wallet->name();
+            } else if (wallet->loginAttemptsRemaining() < attempts) {
+                qWarning().noquote() << "login failed" << wallet->name() << "attempts remaining" << wallet->loginAttemptsRemaining();
+            }
+        });
+        wallet->connect(wallet->proxy(), wallet->useTor());
+    }
+}
+
+Daemon::Request::Request(QLocalSocket* socket, const QJsonValue& id)
+    : m_socket(socket)
+    , m_id(id)
+{
+}
+
+void Daemon::Request::result(const QJsonValue& result) const
+{
+    write({{ "result", result }});
+}
+
+void Daemon::Request::error(int code, const QString& message) const
+{
+    write({{ "error", QJsonObject{{ "code", code }, { "message", message }} }});
+}
+
+void Daemon::Request::write(QJsonObject response) const
+{
+    if (!m_socket) return;
+    response.insert("jsonrpc", "2.0");
+    response.insert("id", m_id);
+    m_socket->write(Json::toCompactJson(response));
+    m_socket->write("\n", 1);
+}
+
+void Daemon::handleConnection(QLocalSocket* socket)
+{
+    connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+    connect(socket, &QLocalSocket::readyRead, this, [this, socket] {
+        while (socket->canReadLine()) {
+            const auto line = socket->readLine().trimmed();
+            if (!line.isEmpty()) handleRequest(socket, line);
+        }
+        if (socket->bytesAvailable() > MAX_REQUEST_SIZE) {
+            Request(socket, QJsonValue::Null).error(INVALID_REQUEST, "request too large");
+            socket->disconnectFromServer();
+        }
+    });
+}
+
+void Daemon::handleRequest(QLocalSocket* socket, const QByteArray& line)
+{
+    QJsonParseError parse_error;
+    const auto doc = QJsonDocument::fromJson(line, &parse_error);
+    if (parse_error.error != QJsonParseError::NoError) {
+        return Request(socket, QJsonValue::Null).error(PARSE_ERROR, parse_error.errorString());
+    }
+    const auto object = doc.object();
+    const Request request(socket, object.value("id"));
+    const auto method = object.value("method");
+    const auto params = object.value("params");
+    if (!doc.isObject() || !method.isString() || !(params.isUndefined() || params.isObject())) {
+        return request.error(INVALID_REQUEST, "invalid request");
+    }
+    dispatch(request, method.toString(), params.toObject());
+}
+
+void Daemon::dispatch(const Request& request, const QString& method, const QJsonObject& params)
+{
+    if (method == "wallets") return wallets(request);
+
+    if (method == "accounts") {
+        if (auto wallet = findWallet(request, params)) accounts(request, wallet);
+        return;
+    }
+
+    Account* account = nullptr;
+    if (method == "balance" || method == "transactions" || method == "receive_address" ||
+        method == "create_transaction" || method == "send_transaction") {
+        account = findAccount(request, params);
+        if (!account) return;
+    } else {
+        return request.error(METHOD_NOT_FOUND, QString("unknown method %1").arg(method));
+    }
+
+    if (method == "balance") return request.result(account->json().value("satoshi"));
+    if (method == "transactions") return transactions(request, account, params);
+    if (method == "receive_address") return receiveAddress(request, account);
+    if (method == "create_transaction") return createTransaction(request, account, params, false);
+    if (method == "send_transaction") return createTransaction(request, account, params, true);
+    Q_UNREACHABLE();
+}
+
+Wallet* Daemon::findWallet(const Request& request, const QJsonObject& params) const
+{
+    const auto key = params.value("wallet").toString();
+    for (auto wallet : m_pins.keys()) {
+        if (wallet->m_id != key && wallet->name() != key) continue;
+        if (!wallet->isAuthenticated()) {
+            request.error(SERVER_ERROR, "wallet not logged in");
+            return nullptr;
+        }
+        return wallet;
+    }
+    request.error(INVALID_PARAMS, QString("unknown wallet %1").arg(key));
+    return nullptr;
+}
+
+Account* Daemon::findAccount(const Request& request, const QJsonObject& params) const
+{
+    auto wallet = findWallet(request, params);
+    if (!wallet) return nullptr;
+    auto account = wallet->m_accounts_by_pointer.value(params.value("subaccount").toInt(0));
+    if (!account) request.error(INVALID_PARAMS, "unknown subaccount");
+    return account;
+}
+
+void Daemon::wallets(const Request& request)
+{
+    QJsonArray result;
+    for (auto wallet : m_pins.keys()) {
+        result.append(QJsonObject{
+            { "id", wallet->m_id },
+            { "name", wallet->name() },
+            { "network", wallet->network()->id() },
+            { "authenticated", wallet->isAuthenticated() }
+        });
+    }
+    request.result(result);
+}
+
+void Daemon::accounts(const Request& request, Wallet* wallet)
+{
+    QJsonArray result;
+    for (auto account : wallet->m_accounts) {
+        result.append(QJsonObject{
+            { "subaccount", account->m_pointer },
+            { "name", account->name() },
+            { "type", account->json().value("type") },
+            { "satoshi", account->json().value("satoshi") }
+        });
+    }
+    request.result(result);
+}
+
+void Daemon::transactions(const Request& request, Account* account, const QJsonObject& params)
+{
+    const int first = params.value("first").toInt(0);
+    const int count = params.value("count").toInt(30);
+    if (first < 0 || count <= 0 || count > 1000) {
+        return request.error(INVALID_PARAMS, "invalid first or count");
+    }
+    auto wallet = account->wallet();
+    const int pointer = account->m_pointer;
+    wallet->m_context->post([wallet, pointer, first, count, request] {
+        const auto transactions = GA::get_transactions(wallet->m_session, pointer, first, count);
+        QMetaObject::invokeMethod(wallet, [request, transactions] {
+            request.result(transactions);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void Daemon::receiveAddress(const Request& request, Account* account)
+{
+    auto wallet = account->wallet();
+    const int pointer = account->m_pointer;
+    wallet->m_context->post([wallet, pointer, request] {
+        auto result = GA::process_auth([wallet, pointer] (GA_auth_handler** call) {
+            auto details = Json::fromObject({{ "subaccount", static_cast<qint64>(pointer) }});
+            int err = GA_get_receive_address(wallet->m_session, details, call);
+            Q_ASSERT(err == GA_OK);
+            err = GA_destroy_json(details);
+            Q_ASSERT(err == GA_OK);
+        });
+        QMetaObject::invokeMethod(wallet, [request, result] {
+            if (result.value("status").toString() != "done") {
+                return request.error(SERVER_ERROR, result.value("error").toString());
+            }
+            request.result(result.value("result").toObject().value("address"));
+        }, Qt::QueuedConnection);
+    });
+}
+
+void Daemon::createTransaction(const Request& request, Account* account, const QJsonObject& params, bool send)
+{
+    auto wallet = account->wallet();
+    const auto address = params.value("address").toString();
+    const bool send_all = params.value("send_all").toBool(false);
+    if (address.isEmpty()) return request.error(INVALID_PARAMS, "missing address");
+
+    // Same inputs as the send dialog, the amount is in the wallet unit unless
+    // given in satoshi.
+    QString amount = params.value("amount").toString();
+    if (params.contains("satoshi")) {
+        const auto unit = wallet->settings().value("unit").toString();
+        amount = Amount::toString(params.value("satoshi").toVariant().toLongLong(), Amount::decimals(unit));
+    }
+    if (amount.isEmpty() && !send_all) return request.error(INVALID_PARAMS, "missing amount");
+
+    Balance* balance = nullptr;
+    if (wallet->network()->isLiquid()) {
+        const auto asset_id = params.value("asset").toString("btc");
+        balance = account->m_balance_by_asset.value(wallet->findAsset(asset_id));
+        if (!balance) return request.error(INVALID_PARAMS, "unknown asset");
+    }
+
+    auto controller = new SendTransactionController(this);
+    controller->setAccount(account);
+    if (balance) controller->setBalance(balance);
+    if (params.contains("fee_rate")) controller->setFeeRate(params.value("fee_rate").toVariant().toLongLong());
+    controller->setMemo(params.value("memo").toString());
+    controller->setSendAll(send_all);
+    if (!send_all) controller->setAmount(amount);
+    controller->setAddress(address);
+
+    // Replies once, whichever of the handlers below completes first.
+    auto replied = QSharedPointer<bool>::create(false);
+    auto reply = [controller, request, replied](const QJsonObject& transaction, const QString& error) {
+        if (*replied) return;
+        *replied = true;
+        if (error.isEmpty()) request.result(transaction); else request.error(SERVER_ERROR, error);
+        controller->deleteLater();
+    };
+    connect(controller, &Controller::error, controller, [reply](Handler* handler) {
+        reply({}, handler->result().value("error").toString());
+    });
+    // With a single method the code is requested right away and only
+    // resolveCode is emitted.
+    for (auto signal : { &Controller::requestCode, &Controller::resolveCode, &Controller::invalidCode }) {
+        connect(controller, signal, controller, [reply] {
+            reply({}, "two factor authentication is not supported in daemon mode");
+        });
+    }
+    QTimer::singleShot(TRANSACTION_TIMEOUT, controller, [reply] {
+        reply({}, "timed out");
+    });
+    // Created transactions become valid once the last requested creation is
+    // done, GDK errors such as insufficient funds are reported inside it.
+    connect(controller, &SendTransactionController::changed, controller, [controller, send, reply, replied] {
+        if (*replied || !controller->isValid()) return;
+        const auto transaction = controller->transaction();
+        const auto error = transaction.value("error").toString();
+        if (!send || !error.isEmpty()) return reply(transaction, error);
+        QObject::disconnect(controller, &SendTransactionController::changed, controller, nullptr);
+        connect(controller, &Controller::finished, controller, [reply, transaction] {
+            reply(transaction, {});
+        });
+        controller->signAndSend();
+    }, Qt::QueuedConnection);
+}
@@ -0,0 +1,61 @@
+#ifndef GREEN_DAEMON_H
+#define GREEN_DAEMON_H
+
+#include <QJsonObject>
+#include <QMap>
+#include <QObject>
+#include <QPointer>
+
+class Account;
+class QCoreApplication;
+class QLocalServer;
+class QLocalSocket;
+class Wallet;
+
+// Headless mode, started with --daemon. Logs in the wallets listed in a PIN
+// file and serves JSON-RPC 2.0 requests, one JSON object per line, on a
+// local socket that only the current user can access.
+class Daemon : public QObject
+{
+    Q_OBJECT
+public:
+    static int exec(QCoreApplication& app);
+
+    explicit Daemon(QObject* parent = nullptr);
+
+    bool loadPins(const QString& path, QString* error);
+    bool listen(const QString& path, QString* error);
+    void login();
+
+private:
+    // Reply to a single request, safe to use after the client disconnects.
+    class Request
+    {
+    public:
+        Request(QLocalSocket* socket, const QJsonValue& id);
+        void result(const QJsonValue& result) const;
+        void error(int code, const QString& message) const;
+    private:
+        void write(QJsonObject response) const;
+        QPointer<QLocalSocket> m_socket;
+        QJsonValue m_id;
+    };
+
+    void handleConnection(QLocalSocket* socket);
+    void handleRequest(QLocalSocket* socket, const QByteArray& line);
+    void dispatch(const Request& request, const QString& method, const QJsonObject& params);
+
+    Wallet* findWallet(const Request& request, const QJsonObject& params) const;
+    Account* findAccount(const Request& request, const QJsonObject& params) const;
+
+    void wallets(const Request& request);
+    void accounts(const Request& request, Wallet* wallet);
+    void transactions(const Request& request, Account* account, const QJsonObject& params);
+    void receiveAddress(const Request& request, Account* account);
+    void createTransaction(const Request& request, Account* account, const QJsonObject& params, bool send);
+
+    QLocalServer* const m_server;
+    QMap<Wallet*, QByteArray> m_pins;
+};
+
+#endif // GREEN_DAEMON_H
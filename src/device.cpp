@@ -1,3 +1,4 @@
+#include "apdu.h"
 #include "device.h"
 #include "device_p.h"
 #include "ga.h"
@@ -5,30 +6,236 @@
 #include "json.h"
 #include "network.h"
 #include "networkmanager.h"
+#include "trace.h"
 #include "wallet.h"
 #include "walletmanager.h"
+#include "xpubcache.h"
 
+namespace {
 
+// Pause before sending a command again after a transport failure.
+const int RETRY_DELAY = 200;
+// Time given to the late response of a command that timed out.
+const int DRAIN_TIMEOUT = 2000;
 
-template <typename T> struct Varint { T v; };
-template <typename T> Varint<T> varint(T v) { return {v}; }
-QDataStream& operator<<(QDataStream& out, const Varint<uint32_t>& v)
+quint16 instructionOf(const QByteArray& apdu)
 {
-    if (v.v < 0xfd) return out << uint8_t(v.v & 0xff);
-    if (v.v < 0xffff) return out << uint8_t(0xfd) << uint8_t(v.v & 0xff) << uint8_t((v.v >> 8) & 0xff);
-    return out << uint8_t(0xfe) << v.v;
+    return apdu.size() < 2 ? 0 : qFromBigEndian<quint16>(apdu.constData());
 }
 
-QByteArray apdu(uint8_t cla, uint8_t ins, uint8_t p1, uint8_t p2, const QByteArray& data = QByteArray())
+} // namespace
+
+DevicePrivate::DevicePrivate()
+{
+    timer.setSingleShot(true);
+    QObject::connect(&timer, &QTimer::timeout, [this] { timeout(); });
+}
+
+DevicePrivate::~DevicePrivate()
+{
+    delete current;
+    qDeleteAll(queue);
+}
+
+void DevicePrivate::exchange(Command* command)
+{
+    if (command->token.isCanceled()) {
+        command->deleteLater();
+        return;
+    }
+    int index = queue.size();
+    while (index > 0 && queue.at(index - 1)->priority < command->priority) --index;
+    queue.insert(index, command);
+    if (state == Idle) next();
+    updateBusy();
+}
+
+void DevicePrivate::cancel(const CancelToken& token)
+{
+    *token.m_canceled = true;
+    for (int i = queue.size() - 1; i >= 0; --i) {
+        if (queue.at(i)->token == token) queue.takeAt(i)->deleteLater();
+    }
+    // The command in flight is completed once its response arrives.
+    if (state == Retrying && current->token == token) finish(false);
+    // A command waiting to be retried is dropped, draining goes on.
+    if (state == Draining && current && current->token == token) {
+        current->deleteLater();
+        current = nullptr;
+    }
+    updateBusy();
+}
+
+void DevicePrivate::next()
+{
+    Q_ASSERT(state == Idle && !current);
+    if (queue.isEmpty()) return;
+    current = queue.takeFirst();
+    dispatch();
+}
+
+void DevicePrivate::dispatch()
 {
-    QByteArray result;
-    QDataStream stream(&result, QIODevice::WriteOnly);
-    Q_ASSERT(data.length() < 256);
-    stream << cla << ins << p1 << p2 << uint8_t(data.length());
-    return result + data;
+    Q_ASSERT(current);
+    const auto apdu = current->payload();
+    state = Waiting;
+    instruction = instructionOf(apdu);
+    sent_at = Trace::now();
+    assembler.clear();
+    if (current->timeout > 0) {
+        timer.start(current->timeout);
+    } else {
+        timer.stop();
+    }
+    if (!send(apdu)) failed();
 }
 
+void DevicePrivate::response(const QByteArray& apdu)
+{
+    if (state == Draining) {
+        qDebug() << "ignoring late response" << apdu.toHex();
+        timer.stop();
+        drained();
+        return;
+    }
+    if (state != Waiting) {
+        qDebug() << "READ UNKNOWN RESPONSE" << apdu.toHex();
+        return;
+    }
+    timer.stop();
+    // The command stays current while it handles the response, so that
+    // commands it exchanges are queued after it.
+    bool ok = false;
+    if (!current->token.isCanceled()) {
+        ok = current->handleResponse(q, apdu);
+        if (!ok) qWarning("command failed");
+    }
+    finish(ok);
+}
+
+void DevicePrivate::report(const char* data, int size)
+{
+    switch (assembler.add(data, size)) {
+    case Apdu::Assembler::Incomplete:
+        return;
+    case Apdu::Assembler::Invalid:
+        qWarning() << "unexpected report";
+        assembler.clear();
+        return;
+    case Apdu::Assembler::Complete:
+        break;
+    }
+    const QByteArray apdu = assembler.response();
+    assembler.clear();
+    response(apdu);
+}
 
+void DevicePrivate::failed()
+{
+    if (state != Waiting) return;
+    if (current->retries > 0 && !current->token.isCanceled()) {
+        --current->retries;
+        state = Retrying;
+        timer.start(RETRY_DELAY);
+        return;
+    }
+    qWarning("failed to send command");
+    if (!current->token.isCanceled()) emit current->error();
+    finish(false);
+}
+
+void DevicePrivate::timeout()
+{
+    switch (state) {
+    case Idle:
+        break;
+    case Waiting:
+        qWarning() << "command timed out" << QByteArray::number(instruction, 16);
+        if (current->retries > 0 && !current->token.isCanceled()) {
+            // The command is sent again once the device answered the
+            // first attempt or the drain timed out, otherwise the second
+            // answer would be taken as the response of the next command.
+            --current->retries;
+            state = Draining;
+            timer.start(DRAIN_TIMEOUT);
+        } else {
+            if (!current->token.isCanceled()) emit current->error();
+            finish(false, true);
+        }
+        break;
+    case Retrying:
+        dispatch();
+        break;
+    case Draining:
+        drained();
+        break;
+    }
+}
+
+// Leaves the Draining state, retrying the current command if any.
+void DevicePrivate::drained()
+{
+    Q_ASSERT(state == Draining);
+    if (current) {
+        dispatch();
+    } else {
+        state = Idle;
+        next();
+    }
+    updateBusy();
+}
+
+// Completes the current command, ok tells if its response was handled.
+void DevicePrivate::finish(bool ok, bool drain)
+{
+    const qint64 duration = Trace::now() - sent_at;
+    if (Trace::isEnabled()) Trace::record("Device APDU", sent_at, sent_at + duration, instruction);
+    auto& latency = latencies[instruction];
+    latency.count++;
+    if (!ok) latency.failures++;
+    latency.total += duration;
+    latency.max = qMax(latency.max, duration);
+
+    timer.stop();
+    auto command = current;
+    current = nullptr;
+    state = Idle;
+    // The rest of the operation can't succeed without this command.
+    if (!ok) cancel(command->token);
+    command->deleteLater();
+
+    if (drain) {
+        state = Draining;
+        timer.start(DRAIN_TIMEOUT);
+    } else {
+        next();
+    }
+    updateBusy();
+    emit q->latencyChanged();
+}
+
+void DevicePrivate::updateBusy()
+{
+    const bool busy = current || !queue.isEmpty();
+    if (this->busy == busy) return;
+    this->busy = busy;
+    emit q->busyChanged();
+}
+
+QJsonObject DevicePrivate::latency() const
+{
+    QJsonObject result;
+    for (auto i = latencies.begin(); i != latencies.end(); ++i) {
+        const auto& latency = i.value();
+        result.insert(QString("%1").arg(i.key(), 4, 16, QChar('0')), QJsonObject{
+            { "count", latency.count },
+            { "failures", latency.failures },
+            { "average_ms", latency.count ? latency.total / latency.count / 1000000.0 : 0.0 },
+            { "max_ms", latency.max / 1000000.0 }
+        });
+    }
+    return result;
+}
 
 Device::Device(DevicePrivate* d, QObject* parent)
     : QObject(parent)
@@ -39,6 +246,7 @@ Device::Device(DevicePrivate* d, QObject* parent)
 
 Device::~Device()
 {
+    qDeleteAll(m_xpub_caches);
     delete d;
 }
 
@@ -49,7 +257,12 @@ Device::Type Device::type() const
 
 bool Device::isBusy() const
 {
-    return !d->queue.empty();
+    return d->isBusy();
+}
+
+QJsonObject Device::latency() const
+{
+    return d->latency();
 }
 
 QString Device::appName() const
@@ -77,71 +290,119 @@ void Device::exchange(Command* command)
     d->exchange(command);
 }
 
-Command* Device::exchange(const QByteArray& data) {
+Command* Device::exchange(const QByteArray& data, Command* parent)
+{
     auto command = new GenericCommand(data);
+    if (parent) {
+        command->inherit(parent);
+        connect(command, &Command::error, parent, &Command::error);
+    }
     d->exchange(command);
     return command;
 }
 
-QByteArray inputBytes(const QJsonObject& input, bool is_segwit)
+void Device::cancel(const CancelToken& token)
 {
-    QByteArray data;
-    QDataStream stream(&data, QIODevice::WriteOnly);
-    stream.setByteOrder(QDataStream::LittleEndian);
+    d->cancel(token);
+}
 
-    QByteArray txhash_hex = QByteArray::fromHex(input["txhash"].toString().toLocal8Bit());
-    for (int i = txhash_hex.size() - 1; i >= 0; --i) {
-        stream << uint8_t(txhash_hex.at(i));
+void Device::getXPubs(Network* network, const QList<QVector<uint32_t>>& paths, std::function<void(const QJsonArray&)> done, std::function<void()> error)
+{
+    auto cache = m_xpub_caches.value(network->id());
+    if (!cache) {
+        // The root key identifies the seed, it's asked once per device.
+        auto command = new GetWalletPublicKeyCommand(network, {});
+        connect(command, &Command::error, this, error);
+        connect(command, &Command::finished, this, [this, command, network, paths, done, error] {
+            if (command->m_xpub.isEmpty()) return error();
+            if (!m_xpub_caches.contains(network->id())) {
+                m_xpub_caches.insert(network->id(), new XPubCache(network, command->m_xpub));
+            }
+            getXPubs(network, paths, done, error);
+        });
+        exchange(command);
+        return;
     }
-    uint32_t pt_idx = input.value("pt_idx").toInt();
-    stream << pt_idx;
-    if (is_segwit) {
-        // TODO ensure "satoshi" is double, not an object
-        const quint64 satoshi = input.value("satoshi").toDouble();
-        stream << satoshi;
+
+    QList<QVector<uint32_t>> missing;
+    for (const auto& path : paths) {
+        if (!cache->value(path).isEmpty()) continue;
+        const auto prefix = XPubCache::hardenedPrefix(path);
+        // The device already gave the key of the prefix, asking it again
+        // wouldn't make the derivation succeed.
+        if (cache->contains(prefix)) return error();
+        if (!missing.contains(prefix)) missing.append(prefix);
     }
-    return data;
-}
 
-int varIntSize(int i) {
-    // if negative, it's actually a very large unsigned long value
-    if (i < 0) return 9; // 1 marker + 8 data bytes
-    if (i< 253) return 1; // 1 data byte
-    if (i <= 0xFFFF) return 3; // 1 marker + 2 data bytes
-    if (i <= 0xFFFFFFFF) return 5; // 1 marker + 4 data bytes
-    return 9; // 1 marker + 8 data bytes
+    if (missing.isEmpty()) {
+        QJsonArray xpubs;
+        for (const auto& path : paths) {
+            xpubs.append(cache->value(path));
+        }
+        done(xpubs);
+        return;
+    }
+
+    // Set to -1 once a command fails, the others are then ignored.
+    auto pending = QSharedPointer<int>::create(missing.size());
+    for (const auto& path : missing) {
+        auto command = new GetWalletPublicKeyCommand(network, path);
+        connect(command, &Command::error, this, [pending, error] {
+            if (*pending < 0) return;
+            *pending = -1;
+            error();
+        });
+        connect(command, &Command::finished, this, [this, command, cache, path, pending, network, paths, done, error] {
+            if (*pending < 0) return;
+            if (command->m_xpub.isEmpty()) {
+                *pending = -1;
+                return error();
+            }
+            cache->insert(path, command->m_xpub);
+            if (--*pending > 0) return;
+            cache->save();
+            getXPubs(network, paths, done, error);
+        });
+        exchange(command);
+    }
 }
 
-void varInt(QDataStream& stream, int64_t i)
+QByteArray inputBytes(const QJsonObject& input, bool is_segwit)
 {
-    switch (varIntSize(i)) {
-    case 1:
-        stream << uint8_t(i);
-        break;
-    case 3:
-        stream << uint8_t(253) << uint8_t(i & 0xff) << uint8_t((i >> 8) & 0xff);
-        break;
-    case 5:
-        stream << uint8_t(254) << uint32_t(i);
-        break;
-    default:
-        stream << uint8_t(255) << qint64(i);
+    // Outpoint (reversed txhash and index) then the amount for segwit.
+    const QByteArray txhash = QByteArray::fromHex(input["txhash"].toString().toLatin1());
+    Q_ASSERT(txhash.size() == 32);
+    QByteArray data(32 + 4 + (is_segwit ? 8 : 0), Qt::Uninitialized);
+    Apdu::Writer writer(data.data(), data.size());
+    for (int i = txhash.size() - 1; i >= 0; --i) {
+        writer.u8(static_cast<quint8>(txhash.at(i)));
     }
+    writer.le(static_cast<quint32>(input.value("pt_idx").toInt()));
+    if (is_segwit) {
+        // TODO ensure "satoshi" is double, not an object
+        writer.le(static_cast<quint64>(input.value("satoshi").toDouble()));
+    }
+    return data;
 }
 
 QByteArray outputBytes(const QJsonArray outputs)
 {
-    QByteArray data;
-    QDataStream stream(&data, QIODevice::WriteOnly);
-    stream.setByteOrder(QDataStream::LittleEndian);
-    varInt(stream, outputs.size());
+    QList<QByteArray> scripts;
+    int size = Apdu::Writer::varintSize(outputs.size());
     for (const auto& out : outputs) {
+        const QByteArray script = QByteArray::fromHex(out["script"].toString().toLatin1());
+        size += 8 + Apdu::Writer::varintSize(script.size()) + script.size();
+        scripts.append(script);
+    }
+
+    QByteArray data(size, Qt::Uninitialized);
+    Apdu::Writer writer(data.data(), data.size());
+    writer.varint(outputs.size());
+    for (int i = 0; i < outputs.size(); ++i) {
         // TODO ensure "satoshi" is double, not an object
-        const quint64 satoshi = out["satoshi"].toDouble();
-        const QByteArray script = QByteArray::fromHex(out["script"].toString().toLocal8Bit());
-        stream << satoshi;
-        varInt(stream, script.size());
-        stream.writeRawData(script.data(), script.size());
+        writer.le(static_cast<quint64>(outputs.at(i)["satoshi"].toDouble()));
+        writer.varint(scripts.at(i).size());
+        writer.bytes(scripts.at(i));
     }
     return data;
 }
@@ -168,9 +429,8 @@ SignTransactionCommand* Device::signTransaction(const QJsonObject& required_data
         auto input = i.toObject();
         Input in;
         uint32_t sequence = input.value("sequence").toDouble();
-        QDataStream stream(&in.sequence, QIODevice::WriteOnly);
-        stream.setByteOrder(QDataStream::LittleEndian);
-        stream << sequence;
+        in.sequence.resize(4);
+        Apdu::Writer(in.sequence.data(), in.sequence.size()).le(sequence);
         in.value = inputBytes(input, segwit);
         in.trusted = false;
         in.segwit = true;
@@ -181,15 +441,15 @@ SignTransactionCommand* Device::signTransaction(const QJsonObject& required_data
 
     auto command = new SignTransactionCommand;
 
-    startUntrustedTransaction(version, new_transaction, input_index, used_inputs, redeem_script, true);
+    startUntrustedTransaction(command, version, new_transaction, input_index, used_inputs, redeem_script, true);
     auto bytes = outputBytes(outputs);
-    finalizeInputFull(bytes);
+    finalizeInputFull(command, bytes);
     signSWInputs(command, used_inputs, inputs, version, locktime);
 
     return command;
 }
 
-void Device::finalizeInputFull(const QByteArray& data)
+void Device::finalizeInputFull(SignTransactionCommand* command, const QByteArray& data)
 {
     qDebug() << "finalizeInputFull";
     QList<QByteArray> datas;
@@ -206,7 +466,7 @@ void Device::finalizeInputFull(const QByteArray& data)
     for (int i = 0; i < datas.size(); ++i) {
         uint8_t p1 = i == 0 ? 0xff : (i == datas.size() - 1 ? 0x80 : 0x00);
         qDebug() << "  " << i << p1 << data.toHex();
-        auto c1 = exchange(apdu(0xe0, 0x4a, p1, 0x00, datas.at(i)));
+        auto c1 = exchange(Apdu::HashInputFinalizeFull::build(p1, 0x00, datas.at(i)), command);
         connect(c1, &Command::finished, [i, datas](QByteArray result) {
            qDebug() << "!!!!!! FINALIZE INPUT FULL" << i << datas.size() << result;
         });
@@ -254,7 +514,7 @@ void Device::signSWInputs(SignTransactionCommand* command, const QList<Input>& h
 void Device::signSWInput(SignTransactionCommand* command, const Input& hwInput, const QJsonObject& input, uint32_t version, uint32_t locktime)
 {
     auto script = QByteArray::fromHex(input.value("prevout_script").toString().toLocal8Bit());
-    startUntrustedTransaction(version, false, 0, {hwInput}, script, true);
+    startUntrustedTransaction(command, version, false, 0, {hwInput}, script, true);
     QList<uint32_t> user_path;
     for (auto v : input.value("user_path").toArray()) {
         uint32_t p = v.toDouble();
@@ -265,35 +525,28 @@ void Device::signSWInput(SignTransactionCommand* command, const Input& hwInput,
 }
 
 
-QByteArray pathToData(const QList<uint32_t>& path)
+// Derivation path as a count followed by big endian indexes.
+template <typename Path>
+void writePath(Apdu::Writer& writer, const Path& path)
 {
     Q_ASSERT(path.size() <= 10);
-    QByteArray data;
-    QDataStream stream(&data, QIODevice::WriteOnly);
-    stream.setByteOrder(QDataStream::BigEndian);
-    stream << uint8_t(path.size());
-    //stream.setByteOrder(QDataStream::LittleEndian);
-    for (int32_t p : path) stream << uint32_t(p);
-    return data;
+    writer.u8(static_cast<quint8>(path.size()));
+    for (uint32_t p : path) writer.be(p);
 }
 
 void Device::untrustedHashSign(SignTransactionCommand* command, const QList<uint32_t>& private_key_path, QString pin, uint32_t locktime, uint8_t sig_hash_type)
 {
-    auto path = pathToData(private_key_path);
-    auto _pin = pin.toUtf8();
-    QByteArray data;
-    QDataStream stream(&data, QIODevice::WriteOnly);
-    stream.writeRawData(path.data(), path.size());
-    stream.setByteOrder(QDataStream::BigEndian);
-    stream << uint8_t(pin.size());
-    stream.writeRawData(_pin.data(), _pin.size());
-    stream << uint32_t(locktime) << sig_hash_type;
+    const auto _pin = pin.toUtf8();
+    char buffer[255];
+    Apdu::Writer writer(buffer, sizeof(buffer));
+    writePath(writer, private_key_path);
+    writer.u8(static_cast<quint8>(_pin.size())).bytes(_pin).be(locktime).u8(sig_hash_type);
     qDebug("untrustedHashSign EXCHANGE");
-    auto c1 = exchange(apdu(0xe0, 0x48, 0, 0, data));
+    auto c1 = exchange(Apdu::HashSign::build(0, 0, buffer, writer.size()), command);
     connect(c1, &Command::error, [] {
        qDebug("untrustedHashSign FAILED!!!!!!!!!");
     });
-    connect(c1, &Command::finished, [command](QByteArray x) {
+    connect(c1, &Command::finished, command, [command](QByteArray x) {
        qDebug("untrustedHashSign FINISHED!!");
        QByteArray signature;
        signature.append(0x30);
@@ -307,44 +560,39 @@ void Device::untrustedHashSign(SignTransactionCommand* command, const QList<uint
 }
 
 
-void Device::startUntrustedTransaction(uint32_t tx_version, bool new_transaction, int64_t input_index, const QList<Input>& used_input, const QByteArray& redeem_script, bool segwit)
+void Device::startUntrustedTransaction(SignTransactionCommand* command, uint32_t tx_version, bool new_transaction, int64_t input_index, const QList<Input>& used_input, const QByteArray& redeem_script, bool segwit)
 {
-    QByteArray data;
-    QDataStream stream(&data, QIODevice::WriteOnly);
-    stream.setByteOrder(QDataStream::LittleEndian);
-
     // Start building a fake transaction with the passed inputs
-    stream << tx_version << varint<uint32_t>(used_input.size());
+    char buffer[4 + 9];
+    Apdu::Writer writer(buffer, sizeof(buffer));
+    writer.le(tx_version).varint(used_input.size());
     const uint8_t p2 = new_transaction ? (segwit ? 0x02 : 0x00) : 0x80;
-    auto c = exchange(apdu(0xe0, 0x44, 0x00, p2, data));
+    auto c = exchange(Apdu::HashInputStart::build(0x00, p2, buffer, writer.size()), command);
     connect(c, &Command::finished, [] {
         qDebug("startUntrustedTransaction OK");
     });
-    hashInputs(used_input, input_index, redeem_script);
+    hashInputs(command, used_input, input_index, redeem_script);
 }
 
-void Device::hashInputs(const QList<Input>& used_inputs, int64_t input_index, const QByteArray& redeem_script)
+void Device::hashInputs(SignTransactionCommand* command, const QList<Input>& used_inputs, int64_t input_index, const QByteArray& redeem_script)
 {
     for (int index = 0; index < used_inputs.size(); ++index) {
-        hashInput(used_inputs.at(index), index == input_index ? redeem_script : QByteArray());
+        hashInput(command, used_inputs.at(index), index == input_index ? redeem_script : QByteArray());
     }
 }
 
-void Device::hashInput(const Input& input, const QByteArray& script)
+void Device::hashInput(SignTransactionCommand* command, const Input& input, const QByteArray& script)
 {
     const uint8_t first = input.segwit ? 0x02 : (input.trusted ? 0x01 : 0x00);
     const QByteArray value = QByteArray::fromHex(input.value);
 
-    QByteArray data;
-    QDataStream stream(&data, QIODevice::WriteOnly);
-    stream.setByteOrder(QDataStream::LittleEndian);
-
-    stream << first;
-    if (input.trusted) stream << uint8_t(input.value.size());
-    stream.writeRawData(input.value.data(), input.value.size());
-    stream << varint<uint32_t>(script.size());
+    char buffer[255];
+    Apdu::Writer writer(buffer, sizeof(buffer));
+    writer.u8(first);
+    if (input.trusted) writer.u8(static_cast<quint8>(input.value.size()));
+    writer.bytes(input.value).varint(script.size());
 
-    auto c1 = exchange(apdu(0xe0, 0x44, 0x80, 0x00, data));
+    auto c1 = exchange(Apdu::HashInputStart::build(0x80, 0x00, buffer, writer.size()), command);
     auto seq = input.sequence;
     connect(c1, &Command::finished, [this, script, seq] {
         qDebug("HASH INPUT 1ST FINISHED");
@@ -353,7 +601,7 @@ void Device::hashInput(const Input& input, const QByteArray& script)
 //        stream.setByteOrder(QDataStream::LittleEndian);
 
     });
-    auto c2 = exchange(apdu(0xe0, 0x44, 0x80, 0x00, script + seq));
+    auto c2 = exchange(Apdu::HashInputStart::build(0x80, 0x00, script + seq), command);
     connect(c2, &Command::finished, [] {
         qDebug("HASH INPUT 2ND FINISHED!");
     });
@@ -402,41 +650,18 @@ void LedgerLoginController::login()
     Q_ASSERT(result.value("status").toString() == "resolve_code");
     Q_ASSERT(result.value("action").toString() == "get_xpubs");
 
-    m_paths = result.value("required_data").toObject().value("paths").toArray();
-
-    for (auto path : m_paths) {
-        qDebug() << " - " << path;
-        qDebug() << " - " << path.toArray();
-        QVector<uint32_t> p;
-        for (auto x : path.toArray()) {
-            qDebug() << "  -- " << x;
-            p.append(x.toDouble());
-        }
-        qDebug() << "get pubkey" << p;
-        auto cmd = new GetWalletPublicKeyCommand(m_network, p);
-        connect(cmd, &Command::finished, [this, cmd] {
-            qDebug() << "FINICHED GET PUBKEY" << cmd->m_xpub;
-
-            m_xpubs.append(cmd->m_xpub);
-
-            if (m_xpubs.size() == m_paths.size()) {
-                QJsonObject code= {{ "xpubs", m_xpubs }};
-                auto _code = QJsonDocument(code).toJson();
-                qDebug() << "RESOLVE CODE" << _code.constData();
-                GA_auth_handler_resolve_code(m_register_handler, _code.constData());
-                qDebug() << GA::auth_handler_get_result(m_register_handler);
-                GA_auth_handler_call(m_register_handler);
-                qDebug() << GA::auth_handler_get_result(m_register_handler);
-
-                m_paths = QJsonArray();
-                m_xpubs = QJsonArray();
-
-
-                login2();
-            }
-        });
-        m_device->exchange(cmd);
-    }
+    const auto paths = XPubCache::parsePaths(result.value("required_data").toObject().value("paths").toArray());
+    m_device->getXPubs(m_network, paths, [this](const QJsonArray& xpubs) {
+        QJsonObject code= {{ "xpubs", xpubs }};
+        auto _code = QJsonDocument(code).toJson();
+        qDebug() << "RESOLVE CODE" << _code.constData();
+        GA_auth_handler_resolve_code(m_register_handler, _code.constData());
+        qDebug() << GA::auth_handler_get_result(m_register_handler);
+        GA_auth_handler_call(m_register_handler);
+        qDebug() << GA::auth_handler_get_result(m_register_handler);
+
+        login2();
+    }, [this] { emit error(); });
 #if 0
     result = GA::process_auth([&] (GA_auth_handler** call) {
         int err = GA_login(m_session, hw_device, "", "", call);
@@ -467,103 +692,64 @@ void LedgerLoginController::login2()
     Q_ASSERT(result.value("status").toString() == "resolve_code");
     Q_ASSERT(result.value("action").toString() == "get_xpubs");
 
-    m_paths = result.value("required_data").toObject().value("paths").toArray();
-
-    for (auto path : m_paths) {
-        qDebug() << " - " << path;
-        qDebug() << " - " << path.toArray();
-        QVector<uint32_t> p;
-        for (auto x : path.toArray()) {
-            qDebug() << "  -- " << x;
-            p.append(x.toDouble());
+    const auto paths = XPubCache::parsePaths(result.value("required_data").toObject().value("paths").toArray());
+    m_device->getXPubs(m_network, paths, [this](const QJsonArray& xpubs) {
+        QJsonObject code= {{ "xpubs", xpubs }};
+        auto _code = QJsonDocument(code).toJson();
+        qDebug() << "LOGIN RESOLVE CODE" << _code.constData();
+        GA_auth_handler_resolve_code(m_login_handler, _code.constData());
+        qDebug() << GA::auth_handler_get_result(m_login_handler);
+        GA_auth_handler_call(m_login_handler);
+        auto result = GA::auth_handler_get_result(m_login_handler);
+        qDebug() << "LOGIN RESULT AFTER CALL" << result;
+        auto required_data = result.value("required_data").toObject();
+        QByteArray message = required_data.value("message").toString().toLocal8Bit();
+        QVector<uint32_t> path;
+        for (auto v : required_data.value("path").toArray()) {
+            path.append(v.toDouble());
         }
-        qDebug() << "get pubkey 2" << p;
-        auto cmd = new GetWalletPublicKeyCommand(m_network, p);
-        connect(cmd, &Command::finished, [this, cmd] {
-            qDebug() << "FINICHED GET PUBKEY" << cmd->m_xpub;
-
-            m_xpubs.append(cmd->m_xpub);
+        auto prepare = new SignMessageCommand(path, message);
+        connect(prepare, &Command::finished, [this] {
+            auto sign = new SignMessageCommand();
+            connect(sign, &Command::finished, [this, sign] {
+                QJsonObject code = {{ "signature", QString::fromLocal8Bit(sign->signature.toHex()) }};
 
-            if (m_xpubs.size() == m_paths.size()) {
-                QJsonObject code= {{ "xpubs", m_xpubs }};
                 auto _code = QJsonDocument(code).toJson();
-                qDebug() << "LOGIN RESOLVE CODE" << _code.constData();
-                GA_auth_handler_resolve_code(m_login_handler, _code.constData());
-                qDebug() << GA::auth_handler_get_result(m_login_handler);
-                GA_auth_handler_call(m_login_handler);
+                qDebug() << "RESOLVE LOGIN CODE" << _code.constData();
+                qDebug() << "GA_auth_handler_resolve_code" << GA_auth_handler_resolve_code(m_login_handler, _code.constData());
+                qDebug() << "RESULT" << GA::auth_handler_get_result(m_login_handler);
+                qDebug() << "GA_auth_handler_call" << GA_auth_handler_call(m_login_handler);
                 auto result = GA::auth_handler_get_result(m_login_handler);
-                qDebug() << "LOGIN RESULT AFTER CALL" << result;
-                auto required_data = result.value("required_data").toObject();
-                QByteArray message = required_data.value("message").toString().toLocal8Bit();
-                QVector<uint32_t> path;
-                for (auto v : required_data.value("path").toArray()) {
-                    path.append(v.toDouble());
-                }
-                auto prepare = new SignMessageCommand(path, message);
-                connect(prepare, &Command::finished, [this] {
-                    auto sign = new SignMessageCommand();
-                    connect(sign, &Command::finished, [this, sign] {
-                        QJsonObject code = {{ "signature", QString::fromLocal8Bit(sign->signature.toHex()) }};
-
-                        auto _code = QJsonDocument(code).toJson();
-                        qDebug() << "RESOLVE LOGIN CODE" << _code.constData();
-                        qDebug() << "GA_auth_handler_resolve_code" << GA_auth_handler_resolve_code(m_login_handler, _code.constData());
-                        qDebug() << "RESULT" << GA::auth_handler_get_result(m_login_handler);
-                        qDebug() << "GA_auth_handler_call" << GA_auth_handler_call(m_login_handler);
-                        auto result = GA::auth_handler_get_result(m_login_handler);
-
-
-                        Q_ASSERT(result.value("status").toString() == "resolve_code");
-                        Q_ASSERT(result.value("action").toString() == "get_xpubs");
-
-                        m_paths = result.value("required_data").toObject().value("paths").toArray();
-                        m_xpubs = QJsonArray();
-
-                        for (auto path : m_paths) {
-                            qDebug() << " - " << path;
-                            qDebug() << " - " << path.toArray();
-                            QVector<uint32_t> p;
-                            for (auto x : path.toArray()) {
-                                qDebug() << "  -- " << x;
-                                p.append(x.toDouble());
-                            }
-                            qDebug() << "get pubkey" << p;
-                            auto cmd = new GetWalletPublicKeyCommand(m_network, p);
-                            connect(cmd, &Command::finished, [this, cmd] {
-                                qDebug() << "FINICHED GET PUBKEY" << cmd->m_xpub;
-
-                                m_xpubs.append(cmd->m_xpub);
-
-                                if (m_xpubs.size() == m_paths.size()) {
-                                    QJsonObject code= {{ "xpubs", m_xpubs }};
-                                    auto _code = QJsonDocument(code).toJson();
-                                    qDebug() << "RESOLVE CODE" << _code.constData();
-                                    GA_auth_handler_resolve_code(m_login_handler, _code.constData());
-                                    qDebug() << GA::auth_handler_get_result(m_login_handler);
-                                    GA_auth_handler_call(m_login_handler);
-                                    qDebug() << GA::auth_handler_get_result(m_login_handler);
-
-                                    m_wallet->setSession();
-                                    m_wallet->m_device = m_device;
-                                    WalletManager::instance()->addWallet(m_wallet);
-
-                                    auto w = m_wallet;
-                                    connect(m_device, &QObject::destroyed, [w] {
-                                        WalletManager::instance()->removeWallet(w);
-                                        delete w;
-                                    });
-                                }
-                            });
-                            m_device->exchange(cmd);
-                        }
+
+
+                Q_ASSERT(result.value("status").toString() == "resolve_code");
+                Q_ASSERT(result.value("action").toString() == "get_xpubs");
+
+                const auto paths = XPubCache::parsePaths(result.value("required_data").toObject().value("paths").toArray());
+                m_device->getXPubs(m_network, paths, [this](const QJsonArray& xpubs) {
+                    QJsonObject code= {{ "xpubs", xpubs }};
+                    auto _code = QJsonDocument(code).toJson();
+                    qDebug() << "RESOLVE CODE" << _code.constData();
+                    GA_auth_handler_resolve_code(m_login_handler, _code.constData());
+                    qDebug() << GA::auth_handler_get_result(m_login_handler);
+                    GA_auth_handler_call(m_login_handler);
+                    qDebug() << GA::auth_handler_get_result(m_login_handler);
+
+                    m_wallet->setSession();
+                    m_wallet->m_device = m_device;
+                    WalletManager::instance()->addWallet(m_wallet);
+
+                    auto w = m_wallet;
+                    connect(m_device, &QObject::destroyed, [w] {
+                        WalletManager::instance()->removeWallet(w);
+                        delete w;
                     });
-                    m_device->exchange(sign);
-                });
-                m_device->exchange(prepare);
-            }
+                }, [this] { emit error(); });
+            });
+            m_device->exchange(sign);
         });
-        m_device->exchange(cmd);
-    }
+        m_device->exchange(prepare);
+    }, [this] { emit error(); });
 }
 
 Device::Type Device::typefromVendorAndProduct(uint32_t vendor_id, uint32_t product_id)
@@ -572,9 +758,15 @@ Device::Type Device::typefromVendorAndProduct(uint32_t vendor_id, uint32_t produ
 }
 
 
+GetFirmwareCommand::GetFirmwareCommand()
+{
+    priority = Low;
+    retries = 2;
+}
+
 QByteArray GetFirmwareCommand::payload() const
 {
-    return apdu(0xe0, 0xc4, 0x00, 0x00);
+    return Apdu::GetFirmwareVersion::build(0x00, 0x00);
 }
 
 bool GetFirmwareCommand::parse(Device* device, QDataStream &stream)
@@ -592,24 +784,33 @@ bool GetFirmwareCommand::parse(Device* device, QDataStream &stream)
     return true;
 }
 
-bool Command::readAPDUResponse(Device* device, int length, QDataStream &stream)
+bool Command::handleResponse(Device* device, const QByteArray& apdu)
 {
-    QByteArray response;
-    if (length > 0) {
-        response.resize(length - 2);
-        stream.readRawData(response.data(), length - 2);
-        qDebug() << __PRETTY_FUNCTION__ << response.mid(2).toHex();
+    if (apdu.size() < 2) {
+        emit error();
+        return false;
     }
-    uint16_t sw;
-    stream >> sw;
+    const auto sw = qFromBigEndian<quint16>(apdu.constData() + apdu.size() - 2);
     if (sw != 0x9000) {
         qDebug() << "SW = " << sw;
         emit error();
         return false;
     }
-    bool result = parse(device, response);
-    if (result) emit finished(response);
-    return result;
+    const QByteArray response = apdu.left(apdu.size() - 2);
+    if (!parse(device, response)) {
+        emit error();
+        return false;
+    }
+    emit finished(response);
+    return true;
+}
+
+void Command::inherit(const Command* other)
+{
+    priority = other->priority;
+    timeout = other->timeout;
+    retries = other->retries;
+    token = other->token;
 }
 
 Command::~Command()
@@ -623,44 +824,15 @@ bool Command::parse(Device* device, const QByteArray& data)
     return parse(device, stream);
 }
 
-int Command::readHIDReport(Device* device, QDataStream& stream)
+GetAppNameCommand::GetAppNameCommand()
 {
-    // General transport
-    uint16_t channel_id;
-    uint8_t command_tag;
-    uint16_t index;
-    stream >> channel_id >> command_tag >> index;
-
-#define CHANNEL_DEFAULT_ID 0x0101
-#define TAG_APDU 0x05
-#define TAG_PING 0x02
-
-    Q_ASSERT(channel_id == CHANNEL_DEFAULT_ID);
-    if (command_tag == TAG_PING) Q_UNIMPLEMENTED();
-    Q_ASSERT(command_tag == TAG_APDU);
-
-    if (index == 0) {
-        Q_ASSERT(buf.size() == 0);
-        stream >> length;
-        buf.resize(length);
-        offset = 0;
-    }
-
-    int read = stream.readRawData(buf.data() + offset, length);
-    length -= read;
-    offset += read;
-
-    if (length > 0) return 2;
-
-    //qDebug() << "READ APDU RESPONSE" << buf.toHex();
-
-    QDataStream s(buf);
-    return readAPDUResponse(device, buf.size(), s) ? 0 : 1;
+    priority = Low;
+    retries = 2;
 }
 
 QByteArray GetAppNameCommand::payload() const
 {
-    return apdu(0xb0, 0x01, 0x00, 0x00);
+    return Apdu::GetAppName::build(0x00, 0x00);
 }
 
 bool GetAppNameCommand::parse(Device* device, QDataStream& stream)
@@ -668,8 +840,8 @@ bool GetAppNameCommand::parse(Device* device, QDataStream& stream)
     uint8_t format;
     stream >> format;
 
-    char* name = new char[256];
-    char* version = new char[256];
+    char name[256];
+    char version[256];
 
     uint8_t name_length, version_length;
 
@@ -688,33 +860,10 @@ QByteArray GetWalletPublicKeyCommand::payload() const
     //s << uint8_t(1) << uint32_t(0);
     //s << uint8_t(2) << uint32_t(0) << uint32_t(2147501889);
     //s << uint8_t(2) << uint32_t(0) << uint32_t(1195487518);
-    QByteArray path;
-    QDataStream s(&path, QIODevice::WriteOnly);
-    s << uint8_t(m_path.size());
-    for (auto p : m_path) s << uint32_t(p);
-    return apdu(0xe0, 0x40, 0x0, 0, path);
-}
-
-extern "C" {
-struct words;
-struct ext_key;
-int bip32_key_free(const struct ext_key *hdkey);
-int bip32_key_init_alloc(uint32_t version,
-                         uint32_t depth,
-                         uint32_t child_num,
-                         const unsigned char *chain_code,
-                         size_t chain_code_len,
-                         const unsigned char *pub_key,
-                         size_t pub_key_len,
-                         const unsigned char *priv_key,
-                         size_t priv_key_len,
-                         const unsigned char *hash160,
-                         size_t hash160_len,
-                         const unsigned char *parent160,
-                         size_t parent160_len,
-                         struct ext_key **output);
-int bip32_key_to_base58(const struct ext_key *hdkey, uint32_t flags, char **output);
-int wally_free_string(char *str);
+    char buffer[1 + 10 * 4];
+    Apdu::Writer writer(buffer, sizeof(buffer));
+    writePath(writer, m_path);
+    return Apdu::GetWalletPublicKey::build(0x0, 0, buffer, writer.size());
 }
 
 QByteArray compressPublicKey(const QByteArray& pubkey)
@@ -735,18 +884,8 @@ QByteArray compressPublicKey(const QByteArray& pubkey)
     return pubkey.mid(1, 32).prepend(type);
 }
 
-/** From wally_bip32.h */
-/** Version codes for extended keys */
-#define BIP32_VER_MAIN_PUBLIC  0x0488B21E
-#define BIP32_VER_TEST_PUBLIC  0x043587CF
-
-/** Indicate that we want to derive a public key in `bip32_key_from_parent` */
-#define BIP32_FLAG_KEY_PUBLIC  0x1
-
 bool GetWalletPublicKeyCommand::parse(Device* device, QDataStream& stream)
 {
-    uint32_t version = m_network->id() == "mainnet" ? BIP32_VER_MAIN_PUBLIC : BIP32_VER_TEST_PUBLIC;
-
     uint8_t pubkey_len, address_len;
     stream >> pubkey_len;
     QByteArray pubkey(pubkey_len, 0);
@@ -764,45 +903,24 @@ bool GetWalletPublicKeyCommand::parse(Device* device, QDataStream& stream)
     qDebug() << pubkey.toHex();
     qDebug() << pubkey.size();
 
-    ext_key* k;
-    int x = bip32_key_init_alloc(version, 1, 0, (const unsigned char *) chain_code.data(), chain_code.length(), (const unsigned char *) pubkey.constData(), pubkey.length(), nullptr, 0, nullptr, 0, nullptr, 0, &k);
-    qDebug() << x;
-
-    char* base58;
-    bip32_key_to_base58(k, BIP32_FLAG_KEY_PUBLIC, &base58);
-    bip32_key_free(k);
+    m_xpub = XPubCache::xpub(m_network, chain_code, pubkey);
+    qDebug() << m_xpub;
 
-    qDebug() << base58;
-
-    m_xpub = QString(base58);
-
-    wally_free_string(base58);
-
-    return true;
+    return !m_xpub.isEmpty();
 }
 
 QByteArray SignMessageCommand::payload() const
 {
     if (!m_message.isEmpty() && !m_path.isEmpty()) {
-        QByteArray data;
-        QDataStream s(&data, QIODevice::WriteOnly);
-        s << uint8_t(m_path.size());
-        for (auto p : m_path) s << uint32_t(p);
-        s << uint8_t(0) << uint8_t(m_message.length());
-        qDebug() << "SIGN" << data.toHex();
-        qDebug() << "MSG " << m_message.toHex();
-        s.writeRawData(m_message.constData(), m_message.size());
-        qDebug() << "SIGN" << data.toHex();
-        //qDebug() << "SIGN MESSAGE" << m_path << m_message;
-        //qDebug() << "SIGN MESSAGE" << m_path << data.toHex();
-        //qDebug() << "SIGN MESSAGE" << m_message.toHex();
-        return apdu(0xe0, 0x4e, 0x0, 1, data);
+        char buffer[255];
+        Apdu::Writer writer(buffer, sizeof(buffer));
+        writePath(writer, m_path);
+        writer.be(static_cast<quint16>(m_message.size())).bytes(m_message);
+        return Apdu::SignMessage::build(0x0, 1, buffer, writer.size());
     }
     Q_ASSERT(m_message.isEmpty() && m_path.isEmpty());
-    QByteArray data;
-    QDataStream s(&data, QIODevice::WriteOnly);
-    s << uint8_t(1) << uint8_t(0);
-    return apdu(0xe0, 0x4e, 0x80, 1, data);
+    const char data[] = { 1, 0 };
+    return Apdu::SignMessage::build(0x80, 1, data, sizeof(data));
 
 }
 
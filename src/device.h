@@ -6,6 +6,8 @@
 
 #include <gdk.h>
 
+#include <functional>
+
 #define LEDGER_VENDOR_ID 0x2c97
 #define LEDGER_NANOS_ID 0x0001
 #define LEDGER_NANOX_ID 0x0004
@@ -15,22 +17,54 @@ class DevicePrivate;
 class Handler;
 class Network;
 class Wallet;
+class XPubCache;
+
+// Identifies the commands of one operation, so that they can be canceled
+// together with Device::cancel. Copies share the same identity.
+class CancelToken
+{
+public:
+    CancelToken() : m_canceled(QSharedPointer<bool>::create(false)) {}
+    bool isCanceled() const { return *m_canceled; }
+    bool operator==(const CancelToken& other) const { return m_canceled == other.m_canceled; }
+private:
+    friend class DevicePrivate;
+    QSharedPointer<bool> m_canceled;
+};
 
 class Command : public QObject
 {
     Q_OBJECT
 public:
+    enum Priority {
+        // Probes, sent when nothing else is pending.
+        Low,
+        Normal,
+        // Signing, kept ahead of everything else.
+        High
+    };
+
+    // Milliseconds to wait for a response.
+    static const int DEFAULT_TIMEOUT = 10000;
+
     virtual ~Command();
     virtual QByteArray payload() const = 0;
     virtual bool parse(Device* device, const QByteArray& data);
     virtual bool parse(Device* device, QDataStream& stream) = 0;
 
-    int readHIDReport(Device* device, QDataStream& stream);
-    bool readAPDUResponse(Device* device, int length, QDataStream& stream);
+    // Handles a complete response APDU, including the status word.
+    bool handleResponse(Device* device, const QByteArray& apdu);
 
-    uint16_t length;
-    uint16_t offset;
-    QByteArray buf;
+    // Copies the scheduling options of the given command.
+    void inherit(const Command* other);
+
+    Priority priority{Normal};
+    // Zero waits forever, for commands the user confirms on the device.
+    int timeout{DEFAULT_TIMEOUT};
+    // Times the command is sent again after a transport failure or a
+    // timeout, only for commands that don't change the device state.
+    int retries{0};
+    CancelToken token;
 signals:
     void error();
     void finished(QByteArray result = QByteArray());
@@ -48,6 +82,7 @@ public:
 class GetAppNameCommand : public Command
 {
 public:
+    GetAppNameCommand();
     QByteArray payload() const override;
     bool parse(Device* device, QDataStream& stream) override;
 };
@@ -55,6 +90,7 @@ public:
 class GetFirmwareCommand : public Command
 {
 public:
+    GetFirmwareCommand();
     QByteArray payload() const override;
     bool parse(Device* device, QDataStream& stream) override;
 };
@@ -75,7 +111,13 @@ public:
         , m_segwit(segwit)
         , m_segwit_native(segwit_native)
         , m_cash_addr(cash_addr)
-    {}
+    {
+        if (show_on_screen) {
+            timeout = 0;
+        } else {
+            retries = 2;
+        }
+    }
     QByteArray payload() const override;
     bool parse(Device* device, QDataStream& stream) override;
     QString m_xpub;
@@ -86,7 +128,8 @@ class SignMessageCommand : public Command
     const QVector<uint32_t> m_path;
     const QByteArray m_message;
 public:
-    SignMessageCommand() {}
+    // Signs the message prepared by the previous command, once confirmed.
+    SignMessageCommand() { timeout = 0; }
     SignMessageCommand(const QVector<uint32_t>& path, const QByteArray& message)
         : m_path(path)
         , m_message(message)
@@ -104,9 +147,16 @@ struct Input {
     bool segwit;
 };
 
+// Not sent itself, carries the scheduling options of the signing commands
+// and collects their signatures.
 class SignTransactionCommand : public Command
 {
 public:
+    SignTransactionCommand()
+    {
+        priority = High;
+        timeout = 0;
+    }
     virtual QByteArray payload() const override { return {}; };
     virtual bool parse(Device* device, QDataStream& stream) override { return true; };
     int count{0};
@@ -125,6 +175,7 @@ class Device : public QObject
 
     Q_PROPERTY(Type type READ type CONSTANT)
     Q_PROPERTY(bool busy READ isBusy NOTIFY busyChanged)
+    Q_PROPERTY(QJsonObject latency READ latency NOTIFY latencyChanged)
     Q_PROPERTY(QString appName READ appName WRITE setAppName NOTIFY appNameChanged)
     QML_ELEMENT
     QML_UNCREATABLE("Devices are instanced by DeviceDiscoveryAgent.")
@@ -141,19 +192,30 @@ public:
     
     Type type() const;
     bool isBusy() const;
+    QJsonObject latency() const;
     QString appName() const;
     void setAppName(const QString& app_name);
 
     static Type typefromVendorAndProduct(uint32_t vendor_id, uint32_t product_id);
 
     void exchange(Command* command);
-    Command* exchange(const QByteArray& data);
+    // A command that is part of the operation of parent inherits its
+    // scheduling options, and its failure is reported by parent.
+    Command* exchange(const QByteArray& data, Command* parent = nullptr);
+    // Drops the pending commands of the operation. A command in flight can't
+    // be aborted, its response is ignored.
+    void cancel(const CancelToken& token);
+
+    // Calls done with the xpubs of the given paths, in the same order. Only
+    // hardened paths missing from the xpub cache are asked to the device.
+    // Calls error instead if the device fails or a key can't be derived.
+    void getXPubs(Network* network, const QList<QVector<uint32_t>>& paths, std::function<void(const QJsonArray&)> done, std::function<void()> error);
 
     SignTransactionCommand* signTransaction(const QJsonObject& required_data);
-    void startUntrustedTransaction(uint32_t tx_version, bool new_transaction, int64_t input_index, const QList<Input>& used_input, const QByteArray& redeemScript, bool segwit);
-    void hashInputs(const QList<Input>& used_inputs, int64_t input_index, const QByteArray& redeem_script);
-    void hashInput(const Input& input, const QByteArray& script);
-    void finalizeInputFull(const QByteArray& data);
+    void startUntrustedTransaction(SignTransactionCommand* command, uint32_t tx_version, bool new_transaction, int64_t input_index, const QList<Input>& used_input, const QByteArray& redeemScript, bool segwit);
+    void hashInputs(SignTransactionCommand* command, const QList<Input>& used_inputs, int64_t input_index, const QByteArray& redeem_script);
+    void hashInput(SignTransactionCommand* command, const Input& input, const QByteArray& script);
+    void finalizeInputFull(SignTransactionCommand* command, const QByteArray& data);
     void signSWInputs(SignTransactionCommand* command, const QList<Input>& hwInputs, const QJsonArray& inputs, uint32_t version, uint32_t locktime);
     void signSWInput(SignTransactionCommand* command, const Input& hwInput, const QJsonObject& input, uint32_t version, uint32_t locktime);
     void untrustedHashSign(SignTransactionCommand* command, const QList<uint32_t>& private_key_path, QString pin, uint32_t locktime, uint8_t sig_hash_type);
@@ -166,6 +228,7 @@ public:
 signals:
     void appNameChanged();
     void busyChanged();
+    void latencyChanged();
 
     void interfaceChanged(const QString& interface);
     void vendorChanged(const QString& vendor);
@@ -184,6 +247,8 @@ private:
     QString m_vendor;
     QString m_product;
     QString m_version;
+    // Caches by network id, created once the root key is known.
+    QMap<QString, XPubCache*> m_xpub_caches;
 };
 
 class LedgerLoginController : public QObject
@@ -193,6 +258,8 @@ public:
     LedgerLoginController(Device* device, Network* network);
     void login();
     void login2();
+signals:
+    void error();
 private:
     Device* const m_device;
     Network* const m_network;
@@ -200,8 +267,6 @@ private:
     Wallet* m_wallet{nullptr};
     GA_auth_handler* m_register_handler;
     GA_auth_handler* m_login_handler;
-    QJsonArray m_paths;
-    QJsonArray m_xpubs;
 };
 
 #endif // GREEN_DEVICE_H
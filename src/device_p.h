@@ -1,17 +1,80 @@
 #ifndef GREEN_DEVICE_P_H
 #define GREEN_DEVICE_P_H
 
+#include "apdu.h"
 #include "device.h"
 
+#include <QTimer>
+
+// Schedules the commands of a device. The device answers one APDU at a
+// time, so a single command is in flight and the others wait in priority
+// order. Transports implement send() and hand back responses with
+// response() or report().
 class DevicePrivate
 {
 public:
-    virtual ~DevicePrivate() {};
-    virtual void exchange(Command* command) = 0;
+    DevicePrivate();
+    virtual ~DevicePrivate();
+
+    // Writes a command APDU, returns false if the transport failed.
+    virtual bool send(const QByteArray& apdu) = 0;
+
+    void exchange(Command* command);
+    void cancel(const CancelToken& token);
+
+    // A complete response APDU, including the status word.
+    void response(const QByteArray& apdu);
+    // A single HID report, for transports that don't reassemble responses.
+    void report(const char* data, int size);
+    // The transport failed writing the command in flight.
+    void failed();
+
+    bool isBusy() const { return busy; }
+    QJsonObject latency() const;
+
     Device* q{nullptr};
     Device::Type type;
     QString app_name;
-    QQueue<Command*> queue;
+
+private:
+    struct Latency
+    {
+        int count{0};
+        int failures{0};
+        qint64 total{0};
+        qint64 max{0};
+    };
+
+    enum State {
+        Idle,
+        // The current command is sent and waits for its response.
+        Waiting,
+        // The current command is sent again once the timer expires.
+        Retrying,
+        // The last command timed out, its late response must not be taken
+        // as the response of the next command. The current command, if
+        // any, is retried once draining is over.
+        Draining
+    };
+
+    void next();
+    void dispatch();
+    void finish(bool ok, bool drain = false);
+    void timeout();
+    void drained();
+    void updateBusy();
+
+    State state{Idle};
+    bool busy{false};
+    // Pending commands, ordered by priority and then by arrival.
+    QList<Command*> queue;
+    Command* current{nullptr};
+    quint16 instruction{0};
+    qint64 sent_at{0};
+    QTimer timer;
+    Apdu::Assembler assembler;
+    // By CLA and INS of the command APDU.
+    QMap<quint16, Latency> latencies;
 };
 
 #endif // GREEN_DEVICE_P_H
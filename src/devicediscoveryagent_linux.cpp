@@ -2,6 +2,7 @@
 
 #ifdef Q_OS_LINUX
 
+#include "apdu.h"
 #include "device.h"
 #include "devicemanager.h"
 
@@ -13,10 +14,181 @@
 #include <linux/hid.h>
 #include <linux/types.h>
 #include <linux/hidraw.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <cerrno>
 #include <unistd.h>
 
+
+HidIoThread::HidIoThread(Handler handler)
+    : m_handler(handler)
+{
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    Q_ASSERT(m_epoll_fd >= 0);
+    m_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    Q_ASSERT(m_event_fd >= 0);
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = m_event_fd;
+    int res = epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_event_fd, &event);
+    Q_ASSERT(res == 0);
+}
+
+HidIoThread::~HidIoThread()
+{
+    if (isRunning()) {
+        post({ Request::Stop, -1, {} });
+        wait();
+    }
+    for (auto i = m_channels.begin(); i != m_channels.end(); ++i) {
+        close(i.key());
+    }
+    close(m_event_fd);
+    close(m_epoll_fd);
+}
+
+void HidIoThread::add(int fd)
+{
+    post({ Request::Add, fd, {} });
+}
+
+void HidIoThread::remove(int fd)
+{
+    post({ Request::Remove, fd, {} });
+}
+
+void HidIoThread::write(int fd, const QByteArray& reports)
+{
+    post({ Request::Write, fd, reports });
+}
+
+void HidIoThread::post(const Request& request)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_requests.append(request);
+    }
+    const uint64_t one = 1;
+    int res = ::write(m_event_fd, &one, sizeof(one));
+    Q_ASSERT(res == sizeof(one));
+}
+
+void HidIoThread::run()
+{
+    epoll_event events[16];
+    while (true) {
+        const int count = epoll_wait(m_epoll_fd, events, 16, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            qWarning() << "epoll_wait failed" << errno;
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == m_event_fd) {
+                if (!process()) return;
+                continue;
+            }
+            auto channel = m_channels.find(fd);
+            if (channel == m_channels.end()) continue;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                // Unplugged, the file descriptor is closed on removal.
+                epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                continue;
+            }
+            read(fd, channel.value());
+        }
+    }
+}
+
+// Applies pending requests, returns false when asked to stop.
+bool HidIoThread::process()
+{
+    uint64_t value;
+    while (::read(m_event_fd, &value, sizeof(value)) > 0) {}
+
+    QList<Request> requests;
+    {
+        QMutexLocker locker(&m_mutex);
+        requests.swap(m_requests);
+    }
+
+    for (const auto& request : requests) {
+        switch (request.type) {
+        case Request::Add: {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = request.fd;
+            if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, request.fd, &event) == 0) {
+                m_channels.insert(request.fd, {});
+            }
+            break;
+        }
+        case Request::Remove:
+            if (m_channels.remove(request.fd) > 0) {
+                epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, request.fd, nullptr);
+                close(request.fd);
+            }
+            break;
+        case Request::Write:
+        {
+            if (!m_channels.contains(request.fd)) break;
+            const int report_size = Apdu::HID_REPORT_SIZE + 1;
+            for (int offset = 0; offset < request.reports.size(); offset += report_size) {
+                const auto res = ::write(request.fd, request.reports.constData() + offset, report_size);
+                if (res != report_size) {
+                    qWarning() << "failed to write report" << errno;
+                    const int fd = request.fd;
+                    QMetaObject::invokeMethod(this, [this, fd] {
+                        m_handler(fd, QByteArray());
+                    }, Qt::QueuedConnection);
+                    break;
+                }
+            }
+            break;
+        }
+        case Request::Stop:
+            return false;
+        }
+    }
+    return true;
+}
+
+void HidIoThread::read(int fd, Apdu::Assembler& assembler)
+{
+    char report[Apdu::HID_REPORT_SIZE];
+    const auto size = ::read(fd, report, sizeof(report));
+    if (size != Apdu::HID_REPORT_SIZE) return;
+
+    switch (assembler.add(report, size)) {
+    case Apdu::Assembler::Incomplete:
+        return;
+    case Apdu::Assembler::Invalid:
+        qWarning() << "unexpected report";
+        return;
+    case Apdu::Assembler::Complete:
+        break;
+    }
+
+    const QByteArray response = assembler.response();
+    assembler.clear();
+    QMetaObject::invokeMethod(this, [this, fd, response] {
+        m_handler(fd, response);
+    }, Qt::QueuedConnection);
+}
+
 DeviceDiscoveryAgentPrivate::DeviceDiscoveryAgentPrivate()
+    : m_io([this](int fd, const QByteArray& response) {
+        for (auto impl : m_devices) {
+            if (impl->fd != fd) continue;
+            if (response.isEmpty()) return impl->failed();
+            return impl->response(response);
+        }
+    })
 {
+    m_io.start();
+
     m_udev = udev_new();
     Q_ASSERT(m_udev);
     m_monitor = udev_monitor_new_from_netlink(m_udev, "udev");
@@ -134,19 +306,13 @@ void DeviceDiscoveryAgentPrivate::addDevice(udev_device* handle)
     auto impl = new DevicePrivateImpl;
     impl->handle = handle;
     impl->fd = fd;
+    impl->io = &m_io;
     impl->type = Device::LedgerNanoX;
     m_devices.insert(devpath, impl);
     auto device = new Device(impl);
     DeviceManager::instance()->addDevice(device);
 
-    auto notifier = new QSocketNotifier(fd, QSocketNotifier::Read);
-    notifier->setEnabled(true);
-    QObject::connect(notifier, &QSocketNotifier::activated, [impl, fd, notifier] {
-        char b[64];
-        auto x = read(fd, (void*) b, 64);
-        if (x == 64) impl->inputReport(QByteArray::fromRawData(b, 64));
-        else notifier->deleteLater();
-    });
+    m_io.add(fd);
 
     QTimer::singleShot(200, device, [device] {
         //manager->exchange(handle, new GetFirmwareCommand);
@@ -161,77 +327,19 @@ void DeviceDiscoveryAgentPrivate::removeDevice(udev_device* handle)
     if (!GetDevPath(handle, devpath)) return;
     DevicePrivateImpl* impl = m_devices.take(devpath);
     if (!impl) return;
+    m_io.remove(impl->fd);
     DeviceManager::instance()->removeDevice(impl->q);
     delete impl->q;
 }
 
-QList<QByteArray> transport(const QByteArray& data) {
-    QList<QByteArray> packets;
-    int offset = 0;
-    //qDebug() << "wrapping" << data.toHex();
-    while (offset < data.size()) {
-        QByteArray result;
-        auto d = data.mid(offset, 64 - (packets.empty() ? 7 : 5));
-        offset += d.size();
-        QDataStream stream(&result, QIODevice::WriteOnly);
-        stream << uint16_t(0x0101) << uint8_t(0x05) << uint16_t(packets.size());
-        if (packets.empty()) stream << uint16_t(data.length());
-        result.append(d);
-        //qDebug() << "  packet " << result.toHex() << result.size();
-        Q_ASSERT(result.length() <= 64);
-        result = result.leftJustified(64, 0x0);
-        packets.append(result);
-    }
-    return packets;
-}
-
-void DevicePrivateImpl::exchange(Command* command)
+bool DevicePrivateImpl::send(const QByteArray& apdu)
 {
-    const bool send = queue.empty();
-    if (send) {
-        const auto payload = command->payload();
-        for (const auto& packet : transport(payload)) {
-            QByteArray report;
-            report.append(uint8_t(0));
-            report.append(packet);
-            int res = write(fd, report.constData(), report.size());
-            Q_ASSERT(res == report.size());
-        }
-    }
-    queue.enqueue(command);
-    if (send) q->busyChanged();
-}
-
-void DevicePrivateImpl::inputReport(const QByteArray& data)
-{
-    if (queue.empty()) {
-        qDebug() << "READ UNKNOWN REPORT" << data.toHex();
-        return;
-    }
-    Q_ASSERT(!queue.empty());
-    QDataStream stream(data);
-    auto command = queue.head();
-    int r = command->readHIDReport(q, stream);
-    if (r == 2) return;
-    if (r == 1) qWarning("command failed");
-    queue.dequeue();
-    if (!queue.empty()) {
-        command = queue.head();
-        const auto payload = command->payload();
-        for (const auto& packet : transport(payload)) {
-            QByteArray report;
-            report.append(uint8_t(0));
-            report.append(packet);
-            int res = write(fd, report.constData(), report.size());
-            if (res < 0) {
-                qDebug() << "FAILED";
-                delete command;
-                return;
-            }
-        }
-    } else {
-        q->busyChanged();
-    }
+    // Reports are written with a zero report id in front. Writes complete
+    // asynchronously, failures are reported with an empty response.
+    QByteArray reports;
+    Apdu::frame(apdu, 1, reports);
+    io->write(fd, reports);
+    return true;
 }
 
 #endif // Q_OS_LINUX
@@ -4,18 +4,66 @@
 #include <QtGlobal>
 
 #ifdef Q_OS_LINUX
+#include "apdu.h"
 #include "device_p.h"
 
+#include <QMutex>
 #include <QSocketNotifier>
+#include <QThread>
 #include <libudev.h>
 
+#include <functional>
+
+// Reads and writes the hidraw file descriptors of all devices from a single
+// thread with epoll. HID reports are reassembled there and only complete
+// APDU responses are handed to the handler, on the thread owning this object.
+// Failed writes are reported with an empty response.
+class HidIoThread : public QThread
+{
+public:
+    using Handler = std::function<void(int fd, const QByteArray& response)>;
+
+    explicit HidIoThread(Handler handler);
+    ~HidIoThread();
+
+    // Thread safe, requests are applied in order by the I/O thread.
+    void add(int fd);
+    // Also closes the file descriptor.
+    void remove(int fd);
+    // Contiguous reports of HID_REPORT_SIZE + 1 bytes, see Apdu::frame.
+    void write(int fd, const QByteArray& reports);
+
+protected:
+    void run() override;
+
+private:
+    struct Request
+    {
+        enum Type { Add, Remove, Write, Stop } type;
+        int fd;
+        QByteArray reports;
+    };
+
+    void post(const Request& request);
+    bool process();
+    void read(int fd, Apdu::Assembler& assembler);
+
+    const Handler m_handler;
+    int m_epoll_fd{-1};
+    int m_event_fd{-1};
+    QMutex m_mutex;
+    QList<Request> m_requests;
+    // Only accessed by the I/O thread.
+    QMap<int, Apdu::Assembler> m_channels;
+};
+
 class DevicePrivateImpl : public DevicePrivate
 {
 public:
     udev_device* handle;
     int fd;
-    void exchange(Command* command) override;
-    void inputReport(const QByteArray& data);
+    HidIoThread* io;
+    bool send(const QByteArray& apdu) override;
 };
 
 class DeviceDiscoveryAgentPrivate
@@ -32,6 +80,7 @@ private:
     udev_monitor* m_monitor{nullptr};
     QSocketNotifier* m_notifier{nullptr};
     QMap<QString, DevicePrivateImpl*> m_devices;
+    HidIoThread m_io;
 };
 
 #endif // Q_OS_LINUX
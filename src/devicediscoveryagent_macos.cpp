@@ -2,6 +2,7 @@
 
 #ifdef Q_OS_MAC
 
+#include "apdu.h"
 #include "device.h"
 #include "devicemanager.h"
 
@@ -125,7 +126,7 @@ static void hid_report_callback(void *context, IOReturn result, void *sender, IO
         auto handle = static_cast<IOHIDDeviceRef>(sender);
         Q_ASSERT(agent->m_devices.contains(handle));
         auto device = agent->m_devices[handle];
-        device->inputReport(QByteArray(reinterpret_cast<const char*>(report), report_length));
+        device->report(reinterpret_cast<const char*>(report), report_length);
     } else {
         qDebug() << __PRETTY_FUNCTION__ << "report_id:" << report_id;
     }
@@ -160,74 +161,17 @@ DeviceDiscoveryAgentPrivate::~DeviceDiscoveryAgentPrivate()
 }
 
 
-QList<QByteArray> transport(const QByteArray& data) {
-    QList<QByteArray> packets;
-    int offset = 0;
-    //qDebug() << "wrapping" << data.toHex();
-    while (offset < data.size()) {
-        QByteArray result;
-        auto d = data.mid(offset, 64 - (packets.empty() ? 7 : 5));
-        offset += d.size();
-        QDataStream stream(&result, QIODevice::WriteOnly);
-        stream << uint16_t(0x0101) << uint8_t(0x05) << uint16_t(packets.size());
-        if (packets.empty()) stream << uint16_t(data.length());
-        result.append(d);
-        //qDebug() << "  packet " << result.toHex() << result.size();
-        Q_ASSERT(result.length() <= 64);
-        result = result.leftJustified(64, 0x0);
-        packets.append(result);
-    }
-    return packets;
-}
-
-void DevicePrivateImpl::exchange(Command* command)
+bool DevicePrivateImpl::send(const QByteArray& apdu)
 {
-    const bool send = queue.empty();
-    if (send) {
-        const auto payload = command->payload();
-        //qDebug() << "send " << payload.toHex();
-        for (const auto& packet : transport(payload)) {
-            //qDebug() << "send packet " << packet.toHex();
-            auto res = IOHIDDeviceSetReport(handle, kIOHIDReportTypeOutput, 0, (const uint8_t*) packet.constData(), packet.size());
-            if (res != kIOReturnSuccess) {
-                qDebug() << "FAILED";
-                return;
-            }
+    Apdu::frame(apdu, 0, reports);
+    for (int offset = 0; offset < reports.size(); offset += Apdu::HID_REPORT_SIZE) {
+        auto res = IOHIDDeviceSetReport(handle, kIOHIDReportTypeOutput, 0, (const uint8_t*) reports.constData() + offset, Apdu::HID_REPORT_SIZE);
+        if (res != kIOReturnSuccess) {
+            qDebug() << "FAILED";
+            return false;
         }
-        //qDebug() << "send done";
-    }
-    queue.enqueue(command);
-    if (send) q->busyChanged();
-}
-
-void DevicePrivateImpl::inputReport(const QByteArray& data)
-{
-    //qDebug() << "read hid" << data.toHex();
-    Q_ASSERT(!queue.empty());
-    QDataStream stream(data);
-    auto command = queue.head();
-    int r = command->readHIDReport(q, stream);
-    if (r == 2) return;
-    if (r == 1) qWarning("command failed");
-    queue.dequeue();
-    if (!queue.empty()) {
-        //qDebug() << "sending next command";
-        command = queue.head();
-        const auto payload = command->payload();
-        //qDebug() << "send " << payload.toHex();
-        for (const auto& packet : transport(payload)) {
-            //qDebug() << "send packet " << packet.toHex();
-            auto res = IOHIDDeviceSetReport(handle, kIOHIDReportTypeOutput, 0, (const uint8_t*) packet.constData(), packet.size());
-            if (res != kIOReturnSuccess) {
-                qDebug() << "FAILED";
-                delete command;
-                return;
-            }
-        }
-        //qDebug() << "send done";
-    } else {
-        q->busyChanged();
     }
+    return true;
 }
 
 #endif // Q_OS_MAC
@@ -15,8 +15,9 @@ class DevicePrivateImpl : public DevicePrivate
 {
 public:
     IOHIDDeviceRef handle;
-    void exchange(Command* command) override;
-    void inputReport(const QByteArray& data);
+    // Framed reports of the command being sent, reused between commands.
+    QByteArray reports;
+    bool send(const QByteArray& apdu) override;
 };
 
 class DeviceDiscoveryAgentPrivate
@@ -2,6 +2,7 @@
 
 #ifdef Q_OS_WIN
 
+#include "apdu.h"
 #include "device.h"
 #include "devicemanager.h"
 
@@ -188,7 +189,7 @@ void DeviceDiscoveryAgentPrivate::addDevice(const QString& id, HANDLE handle)
 
         qDebug() << "read!";
         Q_ASSERT(bytes_read == 65);
-        impl->inputReport(QByteArray::fromRawData(impl->buf + 1, 64));
+        impl->report(impl->buf + 1, 64);
     });
 
     QTimer::singleShot(200, d, [this, d, id, t] {
@@ -207,90 +208,24 @@ void DeviceDiscoveryAgentPrivate::addDevice(const QString& id, HANDLE handle)
     });
 }
 
-QList<QByteArray> transport(const QByteArray& data) {
-    QList<QByteArray> packets;
-    int offset = 0;
-    //qDebug() << "wrapping" << data.toHex();
-    while (offset < data.size()) {
-        QByteArray result;
-        auto d = data.mid(offset, 64 - (packets.empty() ? 7 : 5));
-        offset += d.size();
-        QDataStream stream(&result, QIODevice::WriteOnly);
-        stream << uint16_t(0x0101) << uint8_t(0x05) << uint16_t(packets.size());
-        if (packets.empty()) stream << uint16_t(data.length());
-        result.append(d);
-        //qDebug() << "  packet " << result.toHex() << result.size();
-        Q_ASSERT(result.length() <= 64);
-        result = result.leftJustified(64, 0x0);
-        packets.append(result);
-    }
-    return packets;
-}
-
-void _write(HANDLE handle, const QByteArray& report)
+void _write(HANDLE handle, const char* report, int size)
 {
   DWORD bytes_written;
-	BOOL res;
 	OVERLAPPED ol;
 	memset(&ol, 0, sizeof(ol));
-  qDebug() << "   packet:" << report.toHex();
-  WriteFile(handle, report.constData(), report.size(), NULL, &ol);
+  WriteFile(handle, report, size, NULL, &ol);
   GetOverlappedResult(handle, &ol, &bytes_written, TRUE/*wait*/);
-  qDebug() << "    - packet:" << report.toHex() << bytes_written;
-}
-void DevicePrivateImpl::exchange(Command* command)
-{
-    qDebug() << "EXCHANGE" << queue.empty();
-    const bool send = queue.empty();
-    if (send) {
-        const auto payload = command->payload();
-        qDebug() << "send " << payload.toHex();
-        for (const auto& packet : transport(payload)) {
-            QByteArray report;
-            report.append(uint8_t(0));
-            report.append(packet);
-            _write(handle, report);
-            //int res = write(fd, report.constData(), report.size());
-            //Q_ASSERT(res == report.size());
-        }
-        //qDebug() << "send done";
-    }
-    queue.enqueue(command);
-    if (send) q->busyChanged();
 }
 
-void DevicePrivateImpl::inputReport(const QByteArray& data)
+bool DevicePrivateImpl::send(const QByteArray& apdu)
 {
-    //qDebug() << "read hid" << data.toHex();
-    if (queue.empty()) {
-        qDebug() << "READ UNKNOWN REPORT" << data.toHex();
-        return;
-    }
-    Q_ASSERT(!queue.empty());
-    QDataStream stream(data);
-    auto command = queue.head();
-    int r = command->readHIDReport(q, stream);
-    if (r == 2) return;
-    if (r == 1) qWarning("command failed");
-    queue.dequeue();
-    qDebug() << "input report done, queue size = " << queue.size();
-    if (!queue.empty()) {
-        //qDebug() << "sending next command";
-        command = queue.head();
-        const auto payload = command->payload();
-        //qDebug() << "send " << payload.toHex();
-        for (const auto& packet : transport(payload)) {
-            qDebug() << "send packet " << packet.toHex();
-            //auto res = IOHIDDeviceSetReport(handle, kIOHIDReportTypeOutput, 0, (const uint8_t*) packet.constData(), packet.size());
-            QByteArray report;
-            report.append(uint8_t(0));
-            report.append(packet);
-            _write(handle, report);
-        }
-        //qDebug() << "send done";
-    } else {
-        q->busyChanged();
+    // Reports are written with a zero report id in front.
+    Apdu::frame(apdu, 1, reports);
+    const int report_size = Apdu::HID_REPORT_SIZE + 1;
+    for (int offset = 0; offset < reports.size(); offset += report_size) {
+        _write(handle, reports.constData() + offset, report_size);
     }
+    return true;
 }
 
 #endif // Q_OS_WIN
@@ -24,8 +24,9 @@ public:
     char buf[65];
     // udev_device* handle;
     // int fd;
-    void exchange(Command* command) override;
-    void inputReport(const QByteArray& data);
+    // Framed reports of the command being sent, reused between commands.
+    QByteArray reports;
+    bool send(const QByteArray& apdu) override;
 };
 
 class DeviceDiscoveryAgentPrivate : public QAbstractNativeEventFilter
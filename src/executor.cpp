@@ -0,0 +1,110 @@
+#include "executor.h"
+
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+namespace {
+
+// Tasks run in a row before the thread is handed to other executors.
+const int BATCH_SIZE = 16;
+
+QMutex g_executors_mutex;
+int g_executors{0};
+
+// Tasks block on GDK calls, so the pool must have a thread for each live
+// executor, otherwise one session waiting on the network or a run() call
+// from the GUI could wait on the work of unrelated sessions.
+void updateMaxThreadCount(QThreadPool* pool, int delta)
+{
+    QMutexLocker locker(&g_executors_mutex);
+    g_executors += delta;
+    pool->setMaxThreadCount(qMax(g_executors, QThread::idealThreadCount()));
+}
+
+} // namespace
+
+Executor::Executor(QObject* parent)
+    : QObject(parent)
+{
+    updateMaxThreadCount(pool(), 1);
+}
+
+Executor::~Executor()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_scheduled) m_drained.wait(&m_mutex);
+    locker.unlock();
+    updateMaxThreadCount(pool(), -1);
+}
+
+QThreadPool* Executor::pool()
+{
+    // Intentionally leaked, executors can outlive function local statics.
+    static QThreadPool* pool = new QThreadPool;
+    return pool;
+}
+
+void Executor::post(std::function<void()> task)
+{
+    bool schedule;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_tasks.enqueue(std::move(task));
+        if (++m_pending == 1) emit busyChanged(true);
+        schedule = !m_scheduled;
+        m_scheduled = true;
+    }
+    if (schedule) pool()->start([this] { drain(); });
+}
+
+void Executor::run(std::function<void()> task)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_worker == QThread::currentThread()) {
+            locker.unlock();
+            task();
+            return;
+        }
+    }
+    QSemaphore done;
+    post([&task, &done] {
+        task();
+        done.release();
+    });
+    done.acquire();
+}
+
+int Executor::pending() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_pending;
+}
+
+void Executor::drain()
+{
+    for (int count = 0; ; ++count) {
+        std::function<void()> task;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_tasks.isEmpty()) {
+                m_scheduled = false;
+                m_worker = nullptr;
+                m_drained.wakeAll();
+                return;
+            }
+            if (count == BATCH_SIZE) {
+                m_worker = nullptr;
+                locker.unlock();
+                pool()->start([this] { drain(); });
+                return;
+            }
+            task = m_tasks.dequeue();
+            m_worker = QThread::currentThread();
+        }
+        task();
+        QMutexLocker locker(&m_mutex);
+        if (--m_pending == 0) emit busyChanged(false);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef GREEN_EXECUTOR_H
+#define GREEN_EXECUTOR_H
+
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QWaitCondition>
+
+#include <functional>
+
+class QThread;
+class QThreadPool;
+
+// Runs the GDK calls of one session. Tasks of the same executor run one at a
+// time and in order, while all executors share a pool of threads which are
+// started on demand and expire when idle. The pool has at least one thread
+// per live executor, so a task blocked on the network never delays the
+// tasks of other executors.
+//
+// Tasks must not block on the GUI thread, which may be waiting in run().
+class Executor : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Executor(QObject* parent = nullptr);
+    virtual ~Executor();
+
+    // Queues the task and returns immediately.
+    void post(std::function<void()> task);
+    // Queues the task and waits for it to finish. When called from a task of
+    // this executor the task runs immediately instead.
+    void run(std::function<void()> task);
+
+    // Number of tasks queued or running.
+    int pending() const;
+
+signals:
+    // Emitted from the thread that posted the first task or that completed
+    // the last one, connect with a queued connection.
+    void busyChanged(bool busy);
+
+private:
+    void drain();
+
+    static QThreadPool* pool();
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_drained;
+    QQueue<std::function<void()>> m_tasks;
+    int m_pending{0};
+    bool m_scheduled{false};
+    QThread* m_worker{nullptr};
+};
+
+#endif // GREEN_EXECUTOR_H
@@ -0,0 +1,352 @@
+#include "amount.h"
+#include "exportjob.h"
+#include "json.h"
+
+#include <QLocale>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QtEndian>
+
+#include <functional>
+
+namespace {
+
+// Buffered output is flushed to the file once it reaches this size.
+const int BUFFER_SIZE = 64 * 1024;
+
+// Rows written between progress updates.
+const int PROGRESS_INTERVAL = 1000;
+
+const char COLUMNAR_MAGIC[] = { 'G', 'C', 'O', 'L' };
+const quint8 COLUMNAR_VERSION = 1;
+
+enum ColumnType : quint8 {
+    Int64Column = 0,
+    StringColumn = 1
+};
+
+// Exported values are written with '.' as decimal separator and without
+// group separators, regardless of the system locale.
+QString formatAmount(const ExportRow& row)
+{
+    const auto str = Amount::format(row.amount, row.decimals, QLocale::c(), row.trim);
+    return row.negative ? '-' + str : str;
+}
+
+QString formatFee(const ExportRow& row, int decimals)
+{
+    return row.fee < 0 ? QString() : Amount::format(row.fee, decimals, QLocale::c());
+}
+
+QString formatFiat(const ExportRow& row, double rate)
+{
+    if (!row.fiat || rate <= 0) return {};
+    return QString::number(static_cast<double>(row.amount) * rate / 100000000.0, 'f', 2);
+}
+
+} // namespace
+
+class ExportJob::Output
+{
+public:
+    explicit Output(QSaveFile& file) : m_file(file)
+    {
+        m_buffer.reserve(BUFFER_SIZE + 1024);
+    }
+
+    void append(char c) { m_buffer.append(c); }
+    void append(const QByteArray& data) { m_buffer.append(data); }
+    void append(const char* data, int size) { m_buffer.append(data, size); }
+
+    template <typename T>
+    void appendLittleEndian(T value)
+    {
+        char bytes[sizeof(T)];
+        qToLittleEndian(value, bytes);
+        m_buffer.append(bytes, sizeof(T));
+    }
+
+    void appendCsvField(const QString& value)
+    {
+        if (value.contains(',') || value.contains('"') || value.contains('\n') || value.contains('\r')) {
+            QString quoted = value;
+            quoted.replace('"', "\"\"");
+            m_buffer.append('"').append(quoted.toUtf8()).append('"');
+        } else {
+            m_buffer.append(value.toUtf8());
+        }
+    }
+
+    // Writes the buffer once it is full, returns false on write errors.
+    bool flushIfFull()
+    {
+        return m_buffer.size() < BUFFER_SIZE || flush();
+    }
+
+    bool flush()
+    {
+        if (m_file.write(m_buffer) != m_buffer.size()) return false;
+        m_buffer.resize(0);
+        return true;
+    }
+
+private:
+    QSaveFile& m_file;
+    QByteArray m_buffer;
+};
+
+QString ExportJob::suffix(Format format)
+{
+    switch (format) {
+    case Csv: return "csv";
+    case JsonLines: return "jsonl";
+    case Columnar: return "gcol";
+    }
+    Q_UNREACHABLE();
+}
+
+ExportJob::ExportJob(const QString& file_name, const Options& options, QObject* parent)
+    : QObject(parent)
+    , m_file_name(file_name)
+    , m_options(options)
+    , m_canceled(new QAtomicInt)
+{
+}
+
+ExportJob::~ExportJob()
+{
+    if (m_started && m_running) {
+        cancel();
+        m_done.acquire();
+    }
+}
+
+void ExportJob::start(QVector<ExportRow> rows)
+{
+    Q_ASSERT(!m_started && m_running);
+    m_rows = std::move(rows);
+    m_total = m_rows.size();
+    emit totalChanged(m_total);
+
+    if (isCanceled()) return finish({});
+
+    m_started = true;
+    QThreadPool::globalInstance()->start([this] {
+        run();
+        m_done.release();
+    });
+}
+
+void ExportJob::fail(const QString& error)
+{
+    Q_ASSERT(!m_started && m_running);
+    finish(error);
+}
+
+void ExportJob::cancel()
+{
+    m_canceled->storeRelaxed(1);
+}
+
+void ExportJob::run()
+{
+    QSaveFile file(m_file_name);
+    if (!file.open(QIODevice::WriteOnly)) {
+        const auto error = file.errorString();
+        QMetaObject::invokeMethod(this, [this, error] { finish(error); }, Qt::QueuedConnection);
+        return;
+    }
+
+    Output output(file);
+    bool ok = false;
+    switch (m_options.format) {
+    case Csv:
+        ok = writeCsv(output);
+        break;
+    case JsonLines:
+        ok = writeJsonLines(output);
+        break;
+    case Columnar:
+        ok = writeColumnar(output);
+        break;
+    }
+
+    QString error;
+    if (isCanceled()) {
+        file.cancelWriting();
+    } else if (!ok || !output.flush() || !file.commit()) {
+        error = file.errorString();
+    }
+
+    QMetaObject::invokeMethod(this, [this, error] {
+        setProgress(m_total);
+        finish(error);
+    }, Qt::QueuedConnection);
+}
+
+bool ExportJob::writeCsv(Output& output)
+{
+    const bool header = !m_options.header.isEmpty();
+    if (header) {
+        for (int i = 0; i < m_options.header.size(); ++i) {
+            if (i > 0) output.append(',');
+            output.appendCsvField(m_options.header.at(i));
+            if (i == 0 && m_options.subaccount) output.append(",subaccount", 11);
+        }
+    }
+
+    int count = 0;
+    for (const auto& row : m_rows) {
+        if (count > 0 || header) output.append('\n');
+        output.appendCsvField(row.time);
+        output.append(',');
+        if (m_options.subaccount) {
+            output.append(QByteArray::number(row.subaccount));
+            output.append(',');
+        }
+        output.appendCsvField(row.description);
+        output.append(',');
+        output.append(formatAmount(row).toLatin1());
+        output.append(',');
+        output.appendCsvField(row.unit);
+        output.append(',');
+        output.append(formatFee(row, m_options.fee_decimals).toLatin1());
+        output.append(',');
+        output.append(formatFiat(row, m_options.fiat_rate).toLatin1());
+        output.append(',');
+        output.appendCsvField(row.txhash);
+        output.append(',');
+        output.appendCsvField(row.memo);
+
+        if (!output.flushIfFull()) return false;
+        if (!step(++count)) return true;
+    }
+    return true;
+}
+
+bool ExportJob::writeJsonLines(Output& output)
+{
+    int count = 0;
+    for (const auto& row : m_rows) {
+        QJsonObject object{
+            { "time", row.time },
+            { "description", row.description },
+            { "amount", formatAmount(row) },
+            { "unit", row.unit },
+            { "txhash", row.txhash },
+            { "memo", row.memo }
+        };
+        if (m_options.subaccount) object.insert("subaccount", row.subaccount);
+        if (row.fee >= 0) object.insert("fee", formatFee(row, m_options.fee_decimals));
+        const auto fiat = formatFiat(row, m_options.fiat_rate);
+        if (!fiat.isEmpty()) object.insert("fiat", fiat);
+
+        output.append(Json::toCompactJson(object));
+        output.append('\n');
+
+        if (!output.flushIfFull()) return false;
+        if (!step(++count)) return true;
+    }
+    return true;
+}
+
+// Layout, all integers little endian:
+//   "GCOL", u8 version, u32 row count, u16 column count
+//   then for each column:
+//     u8 type, u16 name size, name (UTF-8)
+//     int64 columns: row count i64 values
+//     string columns: row count + 1 u32 offsets into the following
+//     UTF-8 data, so value i is data[offset[i], offset[i + 1])
+// Amounts are signed integers in base units, see the decimals column, fees
+// are in satoshi and -1 when not applicable.
+bool ExportJob::writeColumnar(Output& output)
+{
+    struct Column
+    {
+        const char* name;
+        ColumnType type;
+        std::function<qint64(const ExportRow&)> integer;
+        std::function<QString(const ExportRow&)> string;
+    };
+    QVector<Column> columns{
+        { "time", StringColumn, nullptr, [](const ExportRow& row) { return row.time; } },
+        { "description", StringColumn, nullptr, [](const ExportRow& row) { return row.description; } },
+        { "amount", Int64Column, [](const ExportRow& row) { return row.negative ? -row.amount : row.amount; }, nullptr },
+        { "decimals", Int64Column, [](const ExportRow& row) { return static_cast<qint64>(row.decimals); }, nullptr },
+        { "unit", StringColumn, nullptr, [](const ExportRow& row) { return row.unit; } },
+        { "fee", Int64Column, [](const ExportRow& row) { return row.fee; }, nullptr },
+        { "fiat", StringColumn, nullptr, [this](const ExportRow& row) { return formatFiat(row, m_options.fiat_rate); } },
+        { "txhash", StringColumn, nullptr, [](const ExportRow& row) { return row.txhash; } },
+        { "memo", StringColumn, nullptr, [](const ExportRow& row) { return row.memo; } }
+    };
+    if (m_options.subaccount) {
+        columns.insert(1, { "subaccount", Int64Column, [](const ExportRow& row) { return static_cast<qint64>(row.subaccount); }, nullptr });
+    }
+
+    output.append(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+    output.appendLittleEndian<quint8>(COLUMNAR_VERSION);
+    output.appendLittleEndian<quint32>(static_cast<quint32>(m_rows.size()));
+    output.appendLittleEndian<quint16>(static_cast<quint16>(columns.size()));
+
+    for (int c = 0; c < columns.size(); ++c) {
+        const auto& column = columns.at(c);
+        const int name_size = static_cast<int>(qstrlen(column.name));
+        output.appendLittleEndian<quint8>(column.type);
+        output.appendLittleEndian<quint16>(static_cast<quint16>(name_size));
+        output.append(column.name, name_size);
+
+        if (column.type == Int64Column) {
+            for (const auto& row : m_rows) {
+                output.appendLittleEndian<qint64>(column.integer(row));
+                if (!output.flushIfFull()) return false;
+            }
+        } else {
+            // Offsets come before the data, so encode the column first.
+            QByteArray data;
+            QVector<quint32> offsets;
+            offsets.reserve(m_rows.size() + 1);
+            offsets.append(0);
+            for (const auto& row : m_rows) {
+                data.append(column.string(row).toUtf8());
+                offsets.append(static_cast<quint32>(data.size()));
+            }
+            for (auto offset : offsets) {
+                output.appendLittleEndian<quint32>(offset);
+                if (!output.flushIfFull()) return false;
+            }
+            if (!output.flush()) return false;
+            output.append(data);
+            if (!output.flush()) return false;
+        }
+
+        // Progress is spread evenly over the columns.
+        const int progress = static_cast<int>(static_cast<qint64>(m_rows.size()) * (c + 1) / columns.size());
+        QMetaObject::invokeMethod(this, [this, progress] { setProgress(progress); }, Qt::QueuedConnection);
+        if (isCanceled()) return true;
+    }
+    return true;
+}
+
+bool ExportJob::step(int count)
+{
+    if (count > 0 && count % PROGRESS_INTERVAL == 0) {
+        QMetaObject::invokeMethod(this, [this, count] { setProgress(count); }, Qt::QueuedConnection);
+    }
+    return !isCanceled();
+}
+
+void ExportJob::setProgress(int progress)
+{
+    if (m_progress == progress) return;
+    m_progress = progress;
+    emit progressChanged(m_progress);
+}
+
+void ExportJob::finish(const QString& error)
+{
+    // The job object is kept around for QML, release the rows now.
+    m_rows = {};
+    m_running = false;
+    m_error = error;
+    emit finished();
+}
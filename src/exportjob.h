@@ -0,0 +1,121 @@
+#ifndef GREEN_EXPORTJOB_H
+#define GREEN_EXPORTJOB_H
+
+#include <QtQml>
+#include <QAtomicInt>
+#include <QObject>
+#include <QSemaphore>
+#include <QSharedPointer>
+#include <QVector>
+
+// Plain copy of the data of one exported amount, taken before the job starts
+// so that formatting and writing don't need to touch wallet objects.
+struct ExportRow
+{
+    QString time;
+    QString description;
+    QString unit;
+    QString txhash;
+    QString memo;
+    int subaccount{0};
+    qint64 amount{0};
+    int decimals{0};
+    bool negative{false};
+    bool trim{true};
+    // Fiat is only computed for bitcoin amounts.
+    bool fiat{false};
+    // Fee in the wallet unit, -1 if not applicable.
+    qint64 fee{-1};
+};
+
+// Writes rows to a file from a pool thread, reporting progress to QML.
+// The file is only replaced once all rows are written.
+class ExportJob : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString fileName READ fileName CONSTANT)
+    Q_PROPERTY(int total READ total NOTIFY totalChanged)
+    Q_PROPERTY(int progress READ progress NOTIFY progressChanged)
+    Q_PROPERTY(bool running READ isRunning NOTIFY finished)
+    Q_PROPERTY(QString error READ error NOTIFY finished)
+    QML_ELEMENT
+    QML_UNCREATABLE("ExportJob is instanced by Account and Wallet.")
+public:
+    enum Format {
+        // Comma separated values, one line per row.
+        Csv,
+        // One compact JSON object per line.
+        JsonLines,
+        // Column oriented binary file, see writeColumnar.
+        Columnar
+    };
+    Q_ENUM(Format)
+
+    struct Options
+    {
+        Format format{Csv};
+        // CSV column titles, in the order time, description, amount, unit,
+        // fee, fiat, txhash and memo.
+        QStringList header;
+        // Adds the subaccount pointer after the time column.
+        bool subaccount{false};
+        // Exchange rate snapshot, 0 when unknown.
+        double fiat_rate{0};
+        int fee_decimals{8};
+    };
+
+    static QString suffix(Format format);
+
+    ExportJob(const QString& file_name, const Options& options, QObject* parent = nullptr);
+    virtual ~ExportJob();
+
+    QString fileName() const { return m_file_name; }
+    int total() const { return m_total; }
+    int progress() const { return m_progress; }
+    bool isRunning() const { return m_running; }
+    QString error() const { return m_error; }
+
+    // Set when the job is canceled. Producers of rows running on other
+    // threads should hold the flag rather than the job, which may be
+    // deleted meanwhile, and stop early when it's set.
+    using CancelFlag = QSharedPointer<QAtomicInt>;
+    CancelFlag cancelFlag() const { return m_canceled; }
+    bool isCanceled() const { return m_canceled->loadRelaxed() != 0; }
+
+    // Writes the given rows. The job counts as running from construction,
+    // so the rows can be produced asynchronously.
+    void start(QVector<ExportRow> rows);
+    void fail(const QString& error);
+
+public slots:
+    void cancel();
+
+signals:
+    void totalChanged(int total);
+    void progressChanged(int progress);
+    void finished();
+
+private:
+    class Output;
+
+    void run();
+    bool writeCsv(Output& output);
+    bool writeJsonLines(Output& output);
+    bool writeColumnar(Output& output);
+    bool step(int count);
+    void setProgress(int progress);
+    void finish(const QString& error);
+
+    const QString m_file_name;
+    const Options m_options;
+    QVector<ExportRow> m_rows;
+    const CancelFlag m_canceled;
+    QSemaphore m_done;
+    bool m_started{false};
+    int m_total{0};
+    int m_progress{0};
+    bool m_running{true};
+    QString m_error;
+};
+
+#endif // GREEN_EXPORTJOB_H
@@ -0,0 +1,59 @@
+#include "feeestimates.h"
+
+namespace {
+
+// Snapshots kept in the history, GDK sends estimates on each block.
+const int HISTORY_SIZE = 144;
+
+} // namespace
+
+FeeEstimates::FeeEstimates(QObject* parent)
+    : QObject(parent)
+{
+}
+
+qint64 FeeEstimates::rate(int blocks) const
+{
+    if (m_rates.isEmpty()) return 0;
+    return m_rates.at(qBound(0, blocks, m_rates.size() - 1));
+}
+
+QJsonArray FeeEstimates::history(int blocks) const
+{
+    QJsonArray history;
+    for (const auto& snapshot : m_history) {
+        if (snapshot.rates.isEmpty()) continue;
+        history.append(QJsonObject{
+            { "time", snapshot.time.toString(Qt::ISODate) },
+            { "rate", snapshot.rates.at(qBound(0, blocks, snapshot.rates.size() - 1)) }
+        });
+    }
+    return history;
+}
+
+void FeeEstimates::update(const QJsonArray& fees)
+{
+    QVector<qint64> rates;
+    rates.reserve(fees.size());
+    for (const auto& fee : fees) {
+        rates.append(fee.toVariant().toLongLong());
+    }
+    if (rates.isEmpty() || rates == m_rates) return;
+
+    if (!m_rates.isEmpty()) {
+        if (m_history.size() == HISTORY_SIZE) m_history.removeFirst();
+        m_history.append({ m_updated, m_rates });
+    }
+    m_rates = rates;
+    m_updated = QDateTime::currentDateTimeUtc();
+    emit changed();
+}
+
+void FeeEstimates::clear()
+{
+    if (m_rates.isEmpty() && m_history.isEmpty()) return;
+    m_rates.clear();
+    m_history.clear();
+    m_updated = {};
+    emit changed();
+}
@@ -0,0 +1,54 @@
+#ifndef GREEN_FEEESTIMATES_H
+#define GREEN_FEEESTIMATES_H
+
+#include <QtQml>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QObject>
+#include <QVector>
+
+// Latest fee estimates of a wallet, fed by the "fees" notification.
+// Estimates are in satoshi per 1000 vbytes, indexed by confirmation target
+// in blocks, where index 0 is the minimum relay fee.
+class FeeEstimates : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool available READ isAvailable NOTIFY changed)
+    Q_PROPERTY(int minimum READ minimum NOTIFY changed)
+    Q_PROPERTY(QDateTime updated READ updated NOTIFY changed)
+    QML_ELEMENT
+    QML_UNCREATABLE("FeeEstimates is instanced by Wallet.")
+public:
+    struct Snapshot
+    {
+        QDateTime time;
+        QVector<qint64> rates;
+    };
+
+    explicit FeeEstimates(QObject* parent = nullptr);
+
+    bool isAvailable() const { return !m_rates.isEmpty(); }
+    int minimum() const { return static_cast<int>(rate(0)); }
+    QDateTime updated() const { return m_updated; }
+
+    // Estimate for the given target, targets past the last estimate use
+    // the last one. Returns 0 when there are no estimates.
+    Q_INVOKABLE qint64 rate(int blocks) const;
+
+    // Previous estimates, oldest first, the latest is not included.
+    const QList<Snapshot>& history() const { return m_history; }
+    Q_INVOKABLE QJsonArray history(int blocks) const;
+
+    void update(const QJsonArray& fees);
+    void clear();
+
+signals:
+    void changed();
+
+private:
+    QVector<qint64> m_rates;
+    QDateTime m_updated;
+    QList<Snapshot> m_history;
+};
+
+#endif // GREEN_FEEESTIMATES_H
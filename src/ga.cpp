@@ -1,5 +1,6 @@
 #include "ga.h"
 #include "json.h"
+#include "trace.h"
 #include <gdk.h>
 
 #include <QDebug>
@@ -8,6 +9,7 @@ namespace GA {
 
 int reconnect_hint(GA_session* session, const QJsonObject& data)
 {
+    Trace::Scope trace("GA_reconnect_hint");
     GA_json* hint = Json::fromObject(data);
     int err = GA_reconnect_hint(session, hint);
     GA_destroy_json(hint);
@@ -16,6 +18,7 @@ int reconnect_hint(GA_session* session, const QJsonObject& data)
 
 int connect(GA_session* session, const QJsonObject& data)
 {
+    Trace::Scope trace("GA_connect");
     GA_json* net_params = Json::fromObject(data);
     int err = GA_connect(session, net_params);
     GA_destroy_json(net_params);
@@ -24,6 +27,7 @@ int connect(GA_session* session, const QJsonObject& data)
 
 QJsonObject auth_handler_get_result(GA_auth_handler* call)
 {
+    Trace::Scope trace("GA_auth_handler_get_status");
     GA_json* output;
     int err = GA_auth_handler_get_status(call, &output);
     Q_ASSERT(err == GA_OK);
@@ -34,6 +38,7 @@ QJsonObject auth_handler_get_result(GA_auth_handler* call)
 
 void destroy_auth_handler(GA_auth_handler* call)
 {
+    Trace::Scope trace("GA_destroy_auth_handler");
     int err = GA_destroy_auth_handler(call);
     Q_ASSERT(err == GA_OK);
 }
@@ -41,6 +46,7 @@ void destroy_auth_handler(GA_auth_handler* call)
 QJsonArray get_subaccounts(GA_session* session)
 {
     Q_ASSERT(session);
+    Trace::Scope trace("GA_get_subaccounts");
     auto result = process_auth([session] (GA_auth_handler** call) {
         int err = GA_get_subaccounts(session, call);
         Q_ASSERT(err == GA_OK);
@@ -49,8 +55,30 @@ QJsonArray get_subaccounts(GA_session* session)
     return result.value("result").toObject().value("subaccounts").toArray();
 }
 
+QJsonArray get_transactions(GA_session* session, int subaccount, int first, int count)
+{
+    Q_ASSERT(session);
+    Trace::Scope trace("GA_get_transactions", count);
+    auto result = process_auth([session, subaccount, first, count] (GA_auth_handler** call) {
+        GA_json* details = Json::fromObject({
+            { "subaccount", subaccount },
+            { "first", first },
+            { "count", count }
+        });
+
+        int err = GA_get_transactions(session, details, call);
+        Q_ASSERT(err == GA_OK);
+
+        err = GA_destroy_json(details);
+        Q_ASSERT(err == GA_OK);
+    });
+    Q_ASSERT(result.value("status").toString() == "done");
+    return result.value("result").toObject().value("transactions").toArray();
+}
+
 QJsonObject convert_amount(GA_session* session, const QJsonObject& input)
 {
+    Trace::Scope trace("GA_convert_amount");
     GA_json* value_details = Json::fromObject(input);
     GA_json* output;
     int err = GA_convert_amount(session, value_details, &output);
@@ -63,6 +91,7 @@ QJsonObject convert_amount(GA_session* session, const QJsonObject& input)
 
 QJsonObject process_auth2(GA_auth_handler* call)
 {
+    Trace::Scope trace("GA::process_auth");
     while (true) {
         QJsonObject result = GA::auth_handler_get_result(call);
         QString status = result.value("status").toString();
@@ -84,6 +113,7 @@ QJsonObject process_auth2(GA_auth_handler* call)
         }
 
         if (status == "call") {
+            Trace::Scope trace("GA_auth_handler_call");
             GA_auth_handler_call(call);
         }
     }
@@ -92,6 +122,7 @@ QJsonObject process_auth2(GA_auth_handler* call)
 
 QStringList generate_mnemonic()
 {
+    Trace::Scope trace("GA_generate_mnemonic");
     char* mnemonic;
     int err = GA_generate_mnemonic(&mnemonic);
     Q_ASSERT(err == GA_OK);
@@ -14,6 +14,7 @@ int connect(GA_session* session, const QJsonObject& data);
 QJsonObject auth_handler_get_result(GA_auth_handler* call);
 void destroy_auth_handler(GA_auth_handler* call);
 QJsonArray get_subaccounts(GA_session* session);
+QJsonArray get_transactions(GA_session* session, int subaccount, int first, int count);
 QJsonObject convert_amount(GA_session* session, const QJsonObject& input);
 QJsonObject process_auth2(GA_auth_handler* call);
 QStringList generate_mnemonic();
@@ -1,5 +1,8 @@
+#include "executor.h"
 #include "ga.h"
 #include "handler.h"
+#include "json.h"
+#include "trace.h"
 
 #include <gdk.h>
 
@@ -13,25 +16,28 @@ Handler::~Handler()
 
 void Handler::exec()
 {
+    // Runs on the wallet context thread, only the outcome is delivered to
+    // the handler thread.
     Q_ASSERT(m_handler);
+    Q_ASSERT(QThread::currentThread() != thread());
+    Trace::Scope trace("Handler::exec");
     for (;;) {
         const auto result = GA::auth_handler_get_result(m_handler);
         const auto status = result.value("status").toString();
 
         if (status == "call") {
+            Trace::Scope trace("GA_auth_handler_call");
             int res = GA_auth_handler_call(m_handler);
             Q_ASSERT(res == GA_OK);
             continue;
         }
 
         if (status == "done") {
-            setResult(result);
-            return emit done();
+            return finish(result, &Handler::done);
         }
 
         if (status == "error") {
-            setResult(result);
-            return emit error();
+            return finish(result, &Handler::error);
         }
 
         if (status == "request_code") {
@@ -43,8 +49,7 @@ void Handler::exec()
                 Q_ASSERT(err == GA_OK);
                 continue;
             } else {
-                setResult(result);
-                return emit requestCode();
+                return finish(result, &Handler::requestCode);
             }
         }
 
@@ -60,19 +65,17 @@ void Handler::exec()
                     m_paths.append(p);
                 }
 
-                setResult(result);
-                return emit resolveCode();
+                return finish(result, &Handler::resolveCode);
             }
 
             // if (action == "enable_2fa" || action == "enable_sms" || action == "disable_2fa")
             {
                 const auto current_method = result.value("method").toString();
                 const auto previous_method = m_result.value("method").toString();
-                setResult(result);
                 if (previous_method == current_method) {
-                    return emit invalidCode();
+                    return finish(result, &Handler::invalidCode);
                 } else {
-                    return emit resolveCode();
+                    return finish(result, &Handler::resolveCode);
                 }
             }
         }
@@ -82,27 +85,46 @@ void Handler::exec()
     }
 }
 
+void Handler::finish(const QJsonObject& result, void (Handler::*signal)())
+{
+    QMetaObject::invokeMethod(this, [this, result, signal] {
+        setResult(result);
+        emit (this->*signal)();
+    }, Qt::QueuedConnection);
+}
+
+void Handler::fail(const QString& error)
+{
+    finish({{ "status", "error" }, { "error", error }}, &Handler::error);
+}
+
 void Handler::request(const QByteArray& method)
 {
     Q_ASSERT(m_handler);
     Q_ASSERT(m_result.value("status").toString() == "request_code");
-    int res = GA_auth_handler_request_code(m_handler, method.data());
-    Q_ASSERT(res == GA_OK);
-    exec();
+    Q_ASSERT(m_context);
+    m_context->post([this, method] {
+        int res = GA_auth_handler_request_code(m_handler, method.data());
+        Q_ASSERT(res == GA_OK);
+        exec();
+    });
 }
 
 void Handler::resolve(const QJsonObject& data)
 {
-    resolve(QJsonDocument(data).toJson(QJsonDocument::Compact));
+    resolve(Json::toCompactJson(data));
 }
 
 void Handler::resolve(const QByteArray& data)
 {
     Q_ASSERT(m_handler);
     Q_ASSERT(m_result.value("status").toString() == "resolve_code");
-    int res = GA_auth_handler_resolve_code(m_handler, data.constData());
-    Q_ASSERT(res == GA_OK);
-    exec();
+    Q_ASSERT(m_context);
+    m_context->post([this, data] {
+        int res = GA_auth_handler_resolve_code(m_handler, data.constData());
+        Q_ASSERT(res == GA_OK);
+        exec();
+    });
 }
 
 void Handler::setResult(const QJsonObject& result)
@@ -4,6 +4,8 @@
 #include <QtQml>
 #include <QJsonObject>
 
+class Executor;
+
 struct GA_session;
 struct GA_auth_handler;
 
@@ -18,8 +20,13 @@ public:
     Handler(QObject* parent);
     virtual ~Handler();
     virtual void init(GA_session* session) = 0;
+    // Drives the auth handler until it needs input or completes, must be
+    // called from the context thread.
     void exec();
     const QJsonObject& result() const { Q_ASSERT(!m_result.empty()); return m_result; }
+    // Fails without going through GDK, for codes that can't be resolved
+    // locally, e.g. when the device fails to sign.
+    void fail(const QString& error);
 public slots:
     void request(const QByteArray& method);
     void resolve(const QJsonObject& data);
@@ -33,12 +40,13 @@ signals:
     void invalidCode();
 private:
     void setResult(const QJsonObject &result);
+    void finish(const QJsonObject& result, void (Handler::*signal)());
 protected:
     GA_auth_handler* m_handler{nullptr};
     QJsonObject m_result;
 public:
+    Executor* m_context{nullptr};
     QList<QVector<uint32_t>> m_paths;
-    QJsonArray m_xpubs;
 };
 
 #endif // GREEN_HANDLER_H
@@ -1,8 +1,12 @@
 #include "json.h"
+#include "trace.h"
 
 #include <gdk.h>
 
 #include <QJsonDocument>
+#include <QLocale>
+
+#include <cmath>
 
 namespace Json {
 
@@ -11,13 +15,158 @@ namespace {
 QJsonDocument doc(const GA_json* json)
 {
     Q_ASSERT(json);
+    Trace::Scope trace("Json::toDocument");
     char* string;
-    GA_convert_json_to_string(json, &string);
-    auto document = QJsonDocument::fromJson(string);
+    int err = GA_convert_json_to_string(json, &string);
+    Q_ASSERT(err == GA_OK);
+    if (err != GA_OK) return {};
+    const int size = static_cast<int>(qstrlen(string));
+    trace.setSize(size);
+    // Parse GDK's buffer in place instead of copying it into a QByteArray first.
+    auto document = QJsonDocument::fromJson(QByteArray::fromRawData(string, size));
     GA_destroy_string(string);
     return document;
 }
 
+// Compact JSON writer for the outbound direction. Output goes to a per thread
+// scratch buffer which keeps its capacity between calls, so the output isn't
+// reallocated as it grows. Strings are still converted to UTF-8 one by one.
+class Writer
+{
+public:
+    explicit Writer(QByteArray& out) : m_out(out) {}
+
+    void write(const QJsonValue& value)
+    {
+        switch (value.type()) {
+        case QJsonValue::Null:
+        case QJsonValue::Undefined:
+            m_out.append("null", 4);
+            break;
+        case QJsonValue::Bool:
+            if (value.toBool()) m_out.append("true", 4); else m_out.append("false", 5);
+            break;
+        case QJsonValue::Double:
+            write(value.toDouble());
+            break;
+        case QJsonValue::String:
+            write(value.toString());
+            break;
+        case QJsonValue::Array:
+            write(value.toArray());
+            break;
+        case QJsonValue::Object:
+            write(value.toObject());
+            break;
+        }
+    }
+
+    void write(const QJsonObject& object)
+    {
+        m_out.append('{');
+        bool first = true;
+        for (auto i = object.constBegin(); i != object.constEnd(); ++i) {
+            if (!first) m_out.append(',');
+            first = false;
+            write(i.key());
+            m_out.append(':');
+            write(i.value());
+        }
+        m_out.append('}');
+    }
+
+    void write(const QJsonArray& array)
+    {
+        m_out.append('[');
+        bool first = true;
+        for (const auto& value : array) {
+            if (!first) m_out.append(',');
+            first = false;
+            write(value);
+        }
+        m_out.append(']');
+    }
+
+private:
+    void write(double value)
+    {
+        if (!std::isfinite(value)) {
+            m_out.append("null", 4);
+            return;
+        }
+        // Same rule as QJsonDocument: integral values within the 53 bit
+        // mantissa are written without exponent or fraction.
+        if (std::fabs(value) < 9007199254740992.0 && value == std::floor(value)) {
+            char buffer[24];
+            char* end = buffer + sizeof(buffer);
+            char* p = end;
+            qint64 n = static_cast<qint64>(value);
+            const bool negative = n < 0;
+            quint64 u = negative ? static_cast<quint64>(-n) : static_cast<quint64>(n);
+            do {
+                *--p = static_cast<char>('0' + u % 10);
+                u /= 10;
+            } while (u);
+            if (negative) *--p = '-';
+            m_out.append(p, static_cast<int>(end - p));
+            return;
+        }
+        m_out.append(QByteArray::number(value, 'g', QLocale::FloatingPointShortest));
+    }
+
+    void write(const QString& string)
+    {
+        static const char hex[] = "0123456789abcdef";
+        m_out.append('"');
+        const QByteArray utf8 = string.toUtf8();
+        const char* begin = utf8.constData();
+        const char* end = begin + utf8.size();
+        const char* run = begin;
+        for (const char* p = begin; p != end; ++p) {
+            const unsigned char c = static_cast<unsigned char>(*p);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            m_out.append(run, static_cast<int>(p - run));
+            run = p + 1;
+            switch (c) {
+            case '"': m_out.append("\\\"", 2); break;
+            case '\\': m_out.append("\\\\", 2); break;
+            case '\b': m_out.append("\\b", 2); break;
+            case '\f': m_out.append("\\f", 2); break;
+            case '\n': m_out.append("\\n", 2); break;
+            case '\r': m_out.append("\\r", 2); break;
+            case '\t': m_out.append("\\t", 2); break;
+            default: {
+                const char escape[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+                m_out.append(escape, 6);
+            }
+            }
+        }
+        m_out.append(run, static_cast<int>(end - run));
+        m_out.append('"');
+    }
+
+    QByteArray& m_out;
+};
+
+QByteArray& scratch()
+{
+    static thread_local QByteArray buffer;
+    // Reserving marks the capacity as reserved, which makes resize(0) keep
+    // the allocation around for the next call.
+    if (buffer.capacity() < 1024) buffer.reserve(1024);
+    buffer.resize(0);
+    return buffer;
+}
+
+GA_json* parse(const QByteArray& data)
+{
+    Trace::Scope trace("Json::fromDocument", data.size());
+    GA_json* json{nullptr};
+    int err = GA_convert_string_to_json(data.constData(), &json);
+    Q_ASSERT(err == GA_OK);
+    return json;
+}
+
 } // namespace
 
 QJsonArray toArray(const GA_json* json)
@@ -32,30 +181,45 @@ QJsonObject toObject(const GA_json *json)
 
 GA_json* fromArray(const QJsonArray& array)
 {
-    GA_json* json;
-    GA_convert_string_to_json(QJsonDocument(array).toJson().constData(), &json);
-    return json;
+    // GDK copies the text, so it's parsed straight from the scratch buffer.
+    auto& buffer = scratch();
+    Writer(buffer).write(array);
+    return parse(buffer);
 }
 
 GA_json* fromObject(const QJsonObject& object)
 {
-    GA_json* json;
-    GA_convert_string_to_json(QJsonDocument(object).toJson().constData(), &json);
-    return json;
+    auto& buffer = scratch();
+    Writer(buffer).write(object);
+    return parse(buffer);
 }
 
 QByteArray toByteArray(const GA_json* json)
 {
+    Trace::Scope trace("Json::toByteArray");
     char* str;
     int err = GA_convert_json_to_string(json, &str);
     Q_ASSERT(err == GA_OK);
+    if (err != GA_OK) return {};
     QByteArray bytearray(str);
+    trace.setSize(bytearray.size());
     GA_destroy_string(str);
     return bytearray;
 }
 
+QByteArray toCompactJson(const QJsonObject& object)
+{
+    auto& buffer = scratch();
+    Writer(buffer).write(object);
+    // Copied out at its final size, the scratch buffer is reused.
+    return QByteArray(buffer.constData(), buffer.size());
+}
 
-} // namespace Json
-
-
+QByteArray toCompactJson(const QJsonArray& array)
+{
+    auto& buffer = scratch();
+    Writer(buffer).write(array);
+    return QByteArray(buffer.constData(), buffer.size());
+}
 
+} // namespace Json
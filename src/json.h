@@ -16,6 +16,10 @@ GA_json* fromObject(const QJsonObject& object);
 
 QByteArray toByteArray(const GA_json* json);
 
+// Serializes to compact JSON text.
+QByteArray toCompactJson(const QJsonObject& object);
+QByteArray toCompactJson(const QJsonArray& array);
+
 } // namespace Json
 
 #endif // GREEN_JSON_H
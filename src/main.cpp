@@ -3,12 +3,17 @@
 #include <QIcon>
 #include <QQmlApplicationEngine>
 #include <QQuickStyle>
+#include <QQuickWindow>
 #include <QStyleHints>
+#include <QTimer>
 #include <QTranslator>
 
+#include "asseticonprovider.h"
 #include "clipboard.h"
+#include "daemon.h"
 #include "devicemanager.h"
 #include "networkmanager.h"
+#include "trace.h"
 #include "walletmanager.h"
 
 #include <QZXing.h>
@@ -25,6 +30,13 @@ Q_IMPORT_PLUGIN(QWindowsIntegrationPlugin);
 Q_IMPORT_PLUGIN(QCocoaIntegrationPlugin);
 #endif
 
+namespace {
+
+// --quit-after-startup exits after this time if no frame was swapped.
+const int STARTUP_TIMEOUT = 60 * 1000;
+
+} // namespace
+
 int main(int argc, char *argv[])
 {
     QCoreApplication::setApplicationName("Green");
@@ -34,7 +46,39 @@ int main(int argc, char *argv[])
     QCoreApplication::setAttribute(Qt::AA_UseHighDpiPixmaps);
     QCoreApplication::setApplicationVersion(QT_STRINGIFY(VERSION));
 
+    // --startup-timing[=<path>] reports the startup phases once the first
+    // frame is shown, --quit-after-startup then exits, e.g. to measure
+    // startup headless with QT_QPA_PLATFORM=offscreen and
+    // QT_QUICK_BACKEND=software.
+    bool quit_after_startup = false;
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--startup-timing") == 0) {
+            Startup::enable({});
+        } else if (qstrncmp(argv[i], "--startup-timing=", 17) == 0) {
+            Startup::enable(QString::fromLocal8Bit(argv[i] + 17));
+        } else if (qstrcmp(argv[i], "--quit-after-startup") == 0) {
+            quit_after_startup = true;
+        }
+    }
+
+    // Headless mode doesn't need a GUI application nor the QML engine.
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--daemon") == 0) {
+            QCoreApplication app(argc, argv);
+            Tracer::instance();
+            const int result = Daemon::exec(app);
+            if (Tracer::instance()->isEnabled()) {
+                Tracer::instance()->dump(qEnvironmentVariable("GREEN_TRACE_FILE"));
+            }
+            return result;
+        }
+    }
+
     QApplication app(argc, argv);
+    Startup::phase("QApplication");
+
+    // Enables tracing as early as possible when GREEN_TRACE_FILE is set.
+    Tracer::instance();
 
     QApplication::setWindowIcon(QIcon(":/png/icon_1024x1024.png"));
 
@@ -46,6 +90,7 @@ int main(int argc, char *argv[])
     Q_ASSERT(id >= 0);
 
     app.styleHints()->setTabFocusBehavior(Qt::TabFocusAllControls);
+    Startup::phase("fonts");
 
     const QLocale locale = QLocale::system();
     const QString language = locale.name().split('_').first();
@@ -62,23 +107,59 @@ int main(int argc, char *argv[])
     app.installTranslator(&english_translator);
     app.installTranslator(&language_translator);
     app.installTranslator(&locale_translator);
+    Startup::phase("translators");
 
     QQuickStyle::setStyle("Material");
 
     qmlRegisterSingletonInstance<Clipboard>("Blockstream.Green.Core", 0, 1, "Clipboard", Clipboard::instance());
     qmlRegisterSingletonInstance<DeviceManager>("Blockstream.Green.Core", 0, 1, "DeviceManager", DeviceManager::instance());
+    Startup::phase("DeviceManager");
     qmlRegisterSingletonInstance<NetworkManager>("Blockstream.Green.Core", 0, 1, "NetworkManager", NetworkManager::instance());
+    Startup::phase("NetworkManager");
+    qmlRegisterSingletonInstance<Tracer>("Blockstream.Green.Core", 0, 1, "Tracer", Tracer::instance());
     qmlRegisterSingletonInstance<WalletManager>("Blockstream.Green.Core", 0, 1, "WalletManager", WalletManager::instance());
+    Startup::phase("WalletManager");
 
     QQmlApplicationEngine engine;
     engine.setBaseUrl(QUrl("qrc:/"));
+    engine.addImageProvider("asset", new AssetIconProvider);
 
     QZXing::registerQMLTypes();
     QZXing::registerQMLImageProvider(engine);
+    Startup::phase("QZXing");
 
     engine.load(QUrl(QStringLiteral("main.qml")));
     if (engine.rootObjects().isEmpty())
         return -1;
-
-    return app.exec();
+    Startup::phase("main.qml");
+
+    auto window = qobject_cast<QQuickWindow*>(engine.rootObjects().first());
+    if (window && Startup::isEnabled()) {
+        // Emitted from the render thread, handled on the GUI thread.
+        QObject::connect(window, &QQuickWindow::frameSwapped, &app, [&app, quit_after_startup] {
+            if (!Startup::isEnabled()) return;
+            Startup::phase("first frame");
+            Startup::report();
+            if (quit_after_startup) app.quit();
+        });
+    }
+    if (quit_after_startup) {
+        // Platforms without a scene graph never swap a frame, report what
+        // was measured instead of running forever.
+        QTimer::singleShot(STARTUP_TIMEOUT, &app, [&app] {
+            if (Startup::isEnabled()) {
+                qWarning("startup: no frame swapped within %d ms", STARTUP_TIMEOUT);
+                Startup::report();
+            }
+            app.quit();
+        });
+    }
+
+    const int result = app.exec();
+
+    if (Tracer::instance()->isEnabled()) {
+        Tracer::instance()->dump(qEnvironmentVariable("GREEN_TRACE_FILE"));
+    }
+
+    return result;
 }
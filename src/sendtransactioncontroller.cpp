@@ -1,5 +1,6 @@
 #include "sendtransactioncontroller.h"
 #include "account.h"
+#include "amount.h"
 #include "asset.h"
 #include "balance.h"
 #include "handler.h"
@@ -11,6 +12,20 @@
 #include <gdk.h>
 
 #include <QDebug>
+#include <QFile>
+#include <QFileDialog>
+#include <QStandardPaths>
+#include <QTextStream>
+#include <QTimer>
+
+namespace {
+
+// Input must be idle this long before a transaction is created.
+const int PREVIEW_DELAY = 300;
+
+const int PREVIEW_CACHE_SIZE = 32;
+
+} // namespace
 
 class CreateTransactionHandler : public Handler
 {
@@ -31,7 +46,18 @@ public:
 
 SendTransactionController::SendTransactionController(QObject* parent)
     : AccountController(parent)
+    , m_create_timer(new QTimer(this))
 {
+    m_create_timer->setSingleShot(true);
+    m_create_timer->setInterval(PREVIEW_DELAY);
+    connect(m_create_timer, &QTimer::timeout, this, &SendTransactionController::preview);
+
+    connect(this, &SendTransactionController::accountChanged, this, [this](Account* account) {
+        m_preview_cache.clear();
+        if (account) {
+            connect(account, &Account::balanceChanged, this, [this] { m_preview_cache.clear(); });
+        }
+    });
     connect(this, &SendTransactionController::accountChanged, this, &SendTransactionController::create);
     connect(this, &SendTransactionController::walletChanged, this, &SendTransactionController::create);
 }
@@ -198,9 +224,6 @@ void SendTransactionController::create()
 {
     if (!wallet()) return;
 
-    const quint64 count = ++m_count;
-    if (m_create_handler) return;
-
     if (!wallet()->network()->isLiquid()) {
         Q_ASSERT(!m_balance);
     }
@@ -212,13 +235,15 @@ void SendTransactionController::create()
     // Also clears m_transaction so that no error is shown.
     if ((m_amount.isEmpty() && m_address.isEmpty()) ||
         (wallet()->network()->isLiquid() && !m_balance)) {
+        m_create_timer->stop();
+        m_request = {};
         m_transaction = {};
         emit transactionChanged();
         return;
     }
 
     if (!m_fee_rate) {
-        m_fee_rate = static_cast<qint64>(wallet()->settings().value("required_num_blocks").toInt());
+        m_fee_rate = wallet()->feeEstimates()->rate(wallet()->settings().value("required_num_blocks").toInt());
     }
 
     QJsonObject address{{ "address", m_address }};
@@ -230,29 +255,64 @@ void SendTransactionController::create()
         const qint64 amount = wallet()->amountToSats(m_effective_amount);
         address.insert("satoshi", amount);
     }
-    QJsonObject data{
+    m_request = {
         { "subaccount", static_cast<qint64>(account()->m_pointer) },
         { "fee_rate", m_fee_rate },
         { "send_all", m_send_all },
         { "addressees", QJsonArray{address}}
     };
 
-    m_create_handler = new CreateTransactionHandler(data, this);
-    connect(m_create_handler, &Handler::done, [this, count] {
-        if (m_count == count) {
-            m_transaction = m_create_handler->result().value("result").toObject();
-            emit transactionChanged();
-            setValid(true);
-            m_count = 0;
-            m_create_handler = nullptr;
-        } else {
-            m_create_handler = nullptr;
-            create();
+    const auto cached = m_preview_cache.constFind(Json::toCompactJson(m_request));
+    if (cached != m_preview_cache.constEnd()) {
+        m_create_timer->stop();
+        setTransaction(cached.value());
+        return;
+    }
+
+    // Restarting the timer drops the previous request before it reaches GDK.
+    m_create_timer->start();
+}
+
+// At most one transaction is created at a time, a request made meanwhile
+// is picked up when it finishes.
+void SendTransactionController::preview()
+{
+    if (m_create_handler || m_request.isEmpty()) return;
+
+    QJsonObject request = m_request;
+    m_create_handler = new CreateTransactionHandler(request, this);
+    connect(m_create_handler, &Handler::done, this, [this, request] {
+        const auto transaction = m_create_handler->result().value("result").toObject();
+        m_create_handler->deleteLater();
+        m_create_handler = nullptr;
+
+        if (m_preview_cache.size() >= PREVIEW_CACHE_SIZE) m_preview_cache.clear();
+        m_preview_cache.insert(Json::toCompactJson(request), transaction);
+
+        if (request == m_request) {
+            setTransaction(transaction);
+        } else if (!m_create_timer->isActive()) {
+            preview();
+        }
+    });
+    connect(m_create_handler, &Handler::error, this, [this, request] {
+        m_create_handler->deleteLater();
+        m_create_handler = nullptr;
+
+        if (request != m_request && !m_create_timer->isActive()) {
+            preview();
         }
     });
     exec(m_create_handler);
 }
 
+void SendTransactionController::setTransaction(const QJsonObject& transaction)
+{
+    m_transaction = transaction;
+    emit transactionChanged();
+    setValid(true);
+}
+
 class SignTransactionHandler : public Handler
 {
     const QJsonObject m_details;
@@ -295,6 +355,7 @@ void SendTransactionController::signAndSend()
         auto send = new SendTransactionHandler(details, this);
         connect(send, &Handler::done, [this, send] {
            send->deleteLater();
+           m_preview_cache.clear();
            wallet()->updateConfig();
            emit finished();
         });
@@ -353,6 +414,10 @@ void BumpFeeController::create()
     auto t = transaction();
     auto a = account();
 
+    if (!m_fee_rate) {
+        m_fee_rate = static_cast<int>(wallet()->feeEstimates()->rate(wallet()->settings().value("required_num_blocks").toInt()));
+    }
+
     QJsonObject details{
         { "subaccount", static_cast<qint64>(a->m_pointer) },
         { "fee_rate", m_fee_rate },
@@ -373,3 +438,353 @@ void BumpFeeController::create()
     });
     exec(m_create_handler);
 }
+
+namespace {
+
+// Splits a CSV line, fields may be quoted with '"' and quotes escaped by
+// doubling them.
+QStringList splitCsvLine(const QString& line)
+{
+    QStringList fields;
+    QString field;
+    bool quoted = false;
+    for (int i = 0; i < line.size(); ++i) {
+        const QChar c = line.at(i);
+        if (quoted) {
+            if (c != '"') {
+                field.append(c);
+            } else if (i + 1 < line.size() && line.at(i + 1) == '"') {
+                field.append(c);
+                ++i;
+            } else {
+                quoted = false;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.append(field.trimmed());
+            field.clear();
+        } else {
+            field.append(c);
+        }
+    }
+    fields.append(field.trimmed());
+    return fields;
+}
+
+// Errors of create_transaction caused by a single addressee. Other errors,
+// like insufficient funds or a network failure, affect the whole batch.
+bool isAddresseeError(const QString& error)
+{
+    static const QStringList errors{
+        "id_invalid_address",
+        "id_invalid_amount",
+        "id_invalid_asset_id",
+        "id_nonconfidential_addresses_not",
+        "id_amount_below_the_dust_threshold"
+    };
+    return errors.contains(error);
+}
+
+} // namespace
+
+BatchSendController::BatchSendController(QObject* parent)
+    : AccountController(parent)
+{
+}
+
+QJsonArray BatchSendController::rows() const
+{
+    QJsonArray rows;
+    for (const auto& row : m_rows) {
+        rows.append(QJsonObject{
+            { "line", row.line },
+            { "address", row.address },
+            { "amount", row.amount },
+            { "asset", row.asset },
+            { "status", row.status },
+            { "error", row.error },
+            { "txhash", row.txhash }
+        });
+    }
+    return rows;
+}
+
+int BatchSendController::validCount() const
+{
+    int count = 0;
+    for (const auto& row : m_rows) {
+        if (row.status != Invalid) ++count;
+    }
+    return count;
+}
+
+int BatchSendController::sentCount() const
+{
+    int count = 0;
+    for (const auto& row : m_rows) {
+        if (row.status == Sent) ++count;
+    }
+    return count;
+}
+
+void BatchSendController::setBatchSize(int batch_size)
+{
+    Q_ASSERT(batch_size > 0);
+    if (m_batch_size == batch_size) return;
+    m_batch_size = batch_size;
+    emit batchSizeChanged(m_batch_size);
+}
+
+void BatchSendController::setFeeRate(int fee_rate)
+{
+    if (m_fee_rate == fee_rate) return;
+    m_fee_rate = fee_rate;
+    emit feeRateChanged(m_fee_rate);
+}
+
+bool BatchSendController::load()
+{
+    const QString name = QFileDialog::getOpenFileName(nullptr, "Load Recipients",
+        QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation),
+        "CSV files (*.csv);;All files (*)");
+    if (name.isEmpty()) return false;
+
+    QString error;
+    if (!loadFile(name, &error)) {
+        qWarning() << "failed to load" << name << error;
+        return false;
+    }
+    return true;
+}
+
+bool BatchSendController::loadFile(const QString& file_name, QString* error)
+{
+    Q_ASSERT(account() && !m_running);
+
+    QFile file(file_name);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+
+    QVector<Row> rows;
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+    int line_number = 0;
+    while (!stream.atEnd()) {
+        const QString line = stream.readLine().trimmed();
+        ++line_number;
+        if (line.isEmpty() || line.startsWith('#')) continue;
+
+        const auto fields = splitCsvLine(line);
+        // Optional header line.
+        if (rows.isEmpty() && fields.first().compare("address", Qt::CaseInsensitive) == 0) continue;
+
+        Row row;
+        row.line = line_number;
+        row.address = fields.value(0);
+        row.amount = fields.value(1);
+        row.asset = fields.value(2);
+        if (fields.size() > 3) {
+            row.status = Invalid;
+            row.error = "too many columns";
+        } else {
+            validate(row);
+        }
+        rows.append(row);
+    }
+
+    m_file_name = file_name;
+    m_rows = rows;
+    m_queue.clear();
+    emit rowsChanged();
+    return true;
+}
+
+// Checks what can be checked without GDK: amount precision and known asset.
+// Addresses are only validated by create_transaction, see the class comment.
+void BatchSendController::validate(Row& row) const
+{
+    auto invalid = [&row](const QString& error) {
+        row.status = Invalid;
+        row.error = error;
+    };
+
+    if (row.address.isEmpty()) return invalid("id_invalid_address");
+
+    int decimals = Amount::decimals(wallet()->settings().value("unit").toString());
+    if (row.asset.isEmpty() || row.asset == "btc") {
+        row.asset = "btc";
+    } else if (!wallet()->network()->isLiquid()) {
+        return invalid("id_invalid_asset");
+    } else {
+        auto balance = account()->m_balance_by_asset.value(wallet()->findAsset(row.asset));
+        if (!balance) return invalid("id_invalid_asset");
+        if (balance->asset()->isLBTC()) {
+            row.asset = "btc";
+        } else {
+            decimals = balance->asset()->data().value("precision").toInt(0);
+        }
+    }
+
+    if (!Amount::parse(row.amount, decimals, &row.satoshi) || row.satoshi == 0) {
+        return invalid("id_invalid_amount");
+    }
+}
+
+void BatchSendController::send()
+{
+    if (m_running || !wallet() || !account()) return;
+
+    if (!m_fee_rate) {
+        setFeeRate(static_cast<int>(wallet()->feeEstimates()->rate(wallet()->settings().value("required_num_blocks").toInt())));
+    }
+
+    // Each transaction pays a single asset, rows keep the file order
+    // within each asset.
+    QStringList assets;
+    QMap<QString, QVector<int>> rows_by_asset;
+    for (int index = 0; index < m_rows.size(); ++index) {
+        const auto& row = m_rows.at(index);
+        if (row.status != Pending) continue;
+        if (!rows_by_asset.contains(row.asset)) assets.append(row.asset);
+        rows_by_asset[row.asset].append(index);
+    }
+
+    m_queue.clear();
+    for (const auto& asset : assets) {
+        const auto& indexes = rows_by_asset.value(asset);
+        for (int offset = 0; offset < indexes.size(); offset += m_batch_size) {
+            m_queue.append(indexes.mid(offset, m_batch_size));
+        }
+    }
+
+    m_stop = false;
+    setRunning(true);
+    next();
+}
+
+void BatchSendController::stop()
+{
+    m_stop = true;
+}
+
+// Batches are processed one at a time, created transactions don't reserve
+// their inputs so the next one can only be created after the previous one
+// is sent.
+void BatchSendController::next()
+{
+    if (m_stop || m_queue.isEmpty()) {
+        const bool completed = !m_stop;
+        m_queue.clear();
+        setRunning(false);
+        if (completed) emit finished();
+        return;
+    }
+    create(m_queue.takeFirst());
+}
+
+void BatchSendController::create(const QVector<int>& batch)
+{
+    setStatus(batch, Creating);
+
+    const bool is_liquid = wallet()->network()->isLiquid();
+    QJsonArray addressees;
+    for (int index : batch) {
+        const auto& row = m_rows.at(index);
+        QJsonObject address{
+            { "address", row.address },
+            { "satoshi", row.satoshi }
+        };
+        if (is_liquid && row.asset != "btc") address.insert("asset_tag", row.asset);
+        addressees.append(address);
+    }
+    QJsonObject data{
+        { "subaccount", static_cast<qint64>(account()->m_pointer) },
+        { "fee_rate", m_fee_rate },
+        { "send_all", false },
+        { "addressees", addressees }
+    };
+
+    auto handler = new CreateTransactionHandler(data, this);
+    connect(handler, &Handler::done, this, [this, handler, batch] {
+        handler->deleteLater();
+        const auto transaction = handler->result().value("result").toObject();
+        const auto error = transaction.value("error").toString();
+        if (error.isEmpty()) return signAndSend(batch, transaction);
+
+        if (!isAddresseeError(error)) {
+            fail(batch, error);
+            return;
+        }
+        if (batch.size() == 1) {
+            setStatus(batch, Failed, error);
+        } else {
+            // Retry both halves, so that a bad row only fails itself.
+            const int half = batch.size() / 2;
+            setStatus(batch, Pending);
+            m_queue.prepend(batch.mid(half));
+            m_queue.prepend(batch.mid(0, half));
+        }
+        next();
+    });
+    connect(handler, &Handler::error, this, [this, handler, batch] { fail(batch, handler); });
+    exec(handler);
+}
+
+void BatchSendController::signAndSend(const QVector<int>& batch, const QJsonObject& transaction)
+{
+    setStatus(batch, Signing);
+    auto sign = new SignTransactionHandler(transaction, this);
+    connect(sign, &Handler::done, this, [this, sign, batch] {
+        sign->deleteLater();
+        setStatus(batch, Sending);
+        auto details = sign->result().value("result").toObject();
+        auto send = new SendTransactionHandler(details, this);
+        connect(send, &Handler::done, this, [this, send, batch] {
+            send->deleteLater();
+            const auto txhash = send->result().value("result").toObject().value("txhash").toString();
+            for (int index : batch) {
+                m_rows[index].txhash = txhash;
+            }
+            setStatus(batch, Sent);
+            wallet()->updateConfig();
+            next();
+        });
+        connect(send, &Handler::error, this, [this, send, batch] { fail(batch, send); });
+        exec(send);
+    });
+    connect(sign, &Handler::error, this, [this, sign, batch] { fail(batch, sign); });
+    exec(sign);
+}
+
+// Errors that are not specific to the batch contents stop the run instead
+// of failing every remaining row the same way.
+void BatchSendController::fail(const QVector<int>& batch, Handler* handler)
+{
+    fail(batch, handler->result().value("error").toString());
+}
+
+void BatchSendController::fail(const QVector<int>& batch, const QString& error)
+{
+    setStatus(batch, Failed, error);
+    m_stop = true;
+    next();
+}
+
+void BatchSendController::setStatus(const QVector<int>& batch, Status status, const QString& error)
+{
+    for (int index : batch) {
+        m_rows[index].status = status;
+        m_rows[index].error = error;
+    }
+    emit rowsChanged();
+}
+
+void BatchSendController::setRunning(bool running)
+{
+    if (m_running == running) return;
+    m_running = running;
+    emit runningChanged(m_running);
+}
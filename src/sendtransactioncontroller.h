@@ -4,9 +4,12 @@
 #include "accountcontroller.h"
 
 #include <QtQml>
+#include <QJsonArray>
 #include <QJsonObject>
+#include <QVector>
 
 class Balance;
+class QTimer;
 class Transaction;
 
 
@@ -70,10 +73,11 @@ signals:
 private:
     void update();
     void create();
+    void preview();
+    void setTransaction(const QJsonObject& transaction);
 
 protected:
     bool m_valid{false};
-    quint64 m_count{0};
     Balance* m_balance{nullptr};
     QString m_address;
     bool m_send_all{false};
@@ -84,6 +88,11 @@ protected:
     QJsonObject m_transaction;
     void setValid(bool valid);
     Handler* m_create_handler{nullptr};
+    // Latest transaction details wanted, created once input settles.
+    QJsonObject m_request;
+    QTimer* const m_create_timer;
+    // Created transactions by request, dropped when the balance changes.
+    QHash<QByteArray, QJsonObject> m_preview_cache;
 };
 
 class BumpFeeController : public AccountController
@@ -111,4 +120,100 @@ signals:
     void txChanged(const QJsonObject& tx);
 };
 
+// Pays many recipients loaded from a CSV file with lines
+//   address,amount[,asset]
+// where amount is in the wallet unit, or in the asset precision for liquid
+// assets. Valid rows are packed into transactions of up to batchSize
+// addressees of the same asset, created, signed and sent one after the
+// other. A batch rejected by create_transaction is split in halves until
+// the offending rows are isolated and marked as failed.
+//
+// Rows are validated locally and in order when the file is loaded. The GDK
+// calls of a wallet are serialized on its executor, so addresses can't be
+// checked in parallel through the session; create_transaction checks them.
+class BatchSendController : public AccountController
+{
+    Q_OBJECT
+    Q_PROPERTY(QString fileName READ fileName NOTIFY rowsChanged)
+    Q_PROPERTY(QJsonArray rows READ rows NOTIFY rowsChanged)
+    Q_PROPERTY(int validCount READ validCount NOTIFY rowsChanged)
+    Q_PROPERTY(int sentCount READ sentCount NOTIFY rowsChanged)
+    Q_PROPERTY(int batchSize READ batchSize WRITE setBatchSize NOTIFY batchSizeChanged)
+    Q_PROPERTY(int feeRate READ feeRate WRITE setFeeRate NOTIFY feeRateChanged)
+    Q_PROPERTY(bool running READ isRunning NOTIFY runningChanged)
+    QML_ELEMENT
+public:
+    enum Status {
+        Pending,
+        Invalid,
+        Creating,
+        Signing,
+        Sending,
+        Sent,
+        Failed
+    };
+    Q_ENUM(Status)
+
+    explicit BatchSendController(QObject* parent = nullptr);
+
+    QString fileName() const { return m_file_name; }
+    QJsonArray rows() const;
+    int validCount() const;
+    int sentCount() const;
+
+    int batchSize() const { return m_batch_size; }
+    void setBatchSize(int batch_size);
+
+    int feeRate() const { return m_fee_rate; }
+    void setFeeRate(int fee_rate);
+
+    bool isRunning() const { return m_running; }
+
+    // Asks for a file and loads it, returns false if nothing was loaded.
+    Q_INVOKABLE bool load();
+    bool loadFile(const QString& file_name, QString* error);
+
+public slots:
+    void send();
+    // Stops after the batch in progress.
+    void stop();
+
+signals:
+    void rowsChanged();
+    void batchSizeChanged(int batch_size);
+    void feeRateChanged(int fee_rate);
+    void runningChanged(bool running);
+
+private:
+    struct Row
+    {
+        int line{0};
+        QString address;
+        QString amount;
+        QString asset;
+        qint64 satoshi{0};
+        Status status{Pending};
+        QString error;
+        QString txhash;
+    };
+
+    void validate(Row& row) const;
+    void next();
+    void create(const QVector<int>& batch);
+    void signAndSend(const QVector<int>& batch, const QJsonObject& transaction);
+    void fail(const QVector<int>& batch, Handler* handler);
+    void fail(const QVector<int>& batch, const QString& error);
+    void setStatus(const QVector<int>& batch, Status status, const QString& error = {});
+    void setRunning(bool running);
+
+    QString m_file_name;
+    QVector<Row> m_rows;
+    // Batches waiting to be created, split batches are pushed to the front.
+    QList<QVector<int>> m_queue;
+    int m_batch_size{100};
+    int m_fee_rate{0};
+    bool m_running{false};
+    bool m_stop{false};
+};
+
 #endif // GREEN_SENDTRANSACTIONCONTROLLER_H
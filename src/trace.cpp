@@ -0,0 +1,234 @@
+#include "trace.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileDialog>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QVector>
+
+namespace Trace {
+
+QAtomicInt g_enabled;
+
+namespace {
+
+// Events kept per thread, older events are overwritten.
+const int CAPACITY = 1 << 14;
+
+struct Event
+{
+    const char* name;
+    qint64 begin;
+    qint64 end;
+    qint64 size;
+};
+
+// Written only by the owning thread. The head is published with release
+// semantics so that dump() sees complete events without taking a lock.
+struct Buffer
+{
+    int tid;
+    QAtomicInteger<quint64> head;
+    Event events[CAPACITY];
+};
+
+QMutex g_mutex;
+QVector<Buffer*> g_buffers;
+QVector<Buffer*> g_free;
+
+QElapsedTimer& clock()
+{
+    static QElapsedTimer timer = [] {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return timer;
+}
+
+// Buffers are never freed, instead the buffer of an exited thread is reused
+// by the next one so pool threads coming and going don't grow the list.
+struct Holder
+{
+    Buffer* const buffer;
+    Holder() : buffer(acquire()) {}
+    ~Holder()
+    {
+        QMutexLocker locker(&g_mutex);
+        g_free.append(buffer);
+    }
+    static Buffer* acquire()
+    {
+        QMutexLocker locker(&g_mutex);
+        if (!g_free.isEmpty()) return g_free.takeLast();
+        auto buffer = new Buffer;
+        buffer->tid = g_buffers.size() + 1;
+        g_buffers.append(buffer);
+        return buffer;
+    }
+};
+
+} // namespace
+
+qint64 now()
+{
+    return clock().nsecsElapsed();
+}
+
+void record(const char* name, qint64 begin, qint64 end, qint64 size)
+{
+    static thread_local Holder holder;
+    Buffer* buffer = holder.buffer;
+    const quint64 head = buffer->head.loadRelaxed();
+    buffer->events[head % CAPACITY] = { name, begin, end, size };
+    buffer->head.storeRelease(head + 1);
+}
+
+} // namespace Trace
+
+namespace Startup {
+
+namespace {
+
+struct Phase
+{
+    const char* name;
+    qint64 begin;
+    qint64 end;
+};
+
+bool g_startup_enabled{false};
+QString g_startup_path;
+QVector<Phase> g_phases;
+qint64 g_start{0};
+qint64 g_phase_begin{0};
+
+} // namespace
+
+void enable(const QString& path)
+{
+    g_startup_enabled = true;
+    g_startup_path = path;
+    g_start = Trace::now();
+    g_phase_begin = g_start;
+}
+
+bool isEnabled()
+{
+    return g_startup_enabled;
+}
+
+void phase(const char* name)
+{
+    if (!g_startup_enabled) return;
+    const qint64 end = Trace::now();
+    g_phases.append({ name, g_phase_begin, end });
+    if (Trace::isEnabled()) Trace::record(name, g_phase_begin, end, 0);
+    g_phase_begin = end;
+}
+
+void report()
+{
+    if (!g_startup_enabled) return;
+    g_startup_enabled = false;
+
+    // Milliseconds since enable().
+    const auto ms = [](qint64 ns) { return (ns - g_start) / 1000000.0; };
+    if (g_startup_path.isEmpty()) {
+        for (const auto& phase : g_phases) {
+            qInfo("startup: %8.2f ms %8.2f ms %s", ms(phase.end), ms(phase.end) - ms(phase.begin), phase.name);
+        }
+        return;
+    }
+
+    QJsonArray phases;
+    for (const auto& phase : g_phases) {
+        phases.append(QJsonObject{
+            { "name", phase.name },
+            { "begin_ms", ms(phase.begin) },
+            { "duration_ms", ms(phase.end) - ms(phase.begin) }
+        });
+    }
+    QSaveFile file(g_startup_path);
+    if (!file.open(QIODevice::WriteOnly)) return;
+    file.write(QJsonDocument(QJsonObject{
+        { "phases", phases },
+        { "total_ms", g_phases.isEmpty() ? 0.0 : ms(g_phases.last().end) }
+    }).toJson());
+    file.commit();
+}
+
+} // namespace Startup
+
+Tracer::Tracer(QObject* parent) : QObject(parent)
+{
+    if (qEnvironmentVariableIsSet("GREEN_TRACE_FILE")) {
+        Trace::now();
+        Trace::g_enabled.storeRelaxed(1);
+    }
+}
+
+Tracer* Tracer::instance()
+{
+    static Tracer instance;
+    return &instance;
+}
+
+bool Tracer::dump(const QString& path) const
+{
+    using namespace Trace;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    QVector<Buffer*> buffers;
+    {
+        QMutexLocker locker(&g_mutex);
+        buffers = g_buffers;
+    }
+
+    // Events being written while dumping may be torn, which is acceptable
+    // for a diagnostic snapshot.
+    QByteArray out;
+    out.append("{\"traceEvents\":[");
+    bool first = true;
+    for (const auto buffer : buffers) {
+        const quint64 head = buffer->head.loadAcquire();
+        const quint64 begin = head > CAPACITY ? head - CAPACITY : 0;
+        for (quint64 i = begin; i < head; ++i) {
+            const Event& event = buffer->events[i % CAPACITY];
+            if (!first) out.append(',');
+            first = false;
+            out.append("{\"name\":\"").append(event.name)
+               .append("\",\"ph\":\"X\",\"pid\":1,\"tid\":").append(QByteArray::number(buffer->tid))
+               .append(",\"ts\":").append(QByteArray::number(event.begin / 1000.0, 'f', 3))
+               .append(",\"dur\":").append(QByteArray::number((event.end - event.begin) / 1000.0, 'f', 3))
+               .append(",\"args\":{\"size\":").append(QByteArray::number(event.size))
+               .append("}}");
+        }
+        if (out.size() > (1 << 20)) {
+            file.write(out);
+            out.resize(0);
+        }
+    }
+    out.append("],\"displayTimeUnit\":\"ms\"}\n");
+    file.write(out);
+    return file.commit();
+}
+
+void Tracer::save() const
+{
+    const auto now = QDateTime::currentDateTime();
+    const QString suggestion =
+            QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation) + QDir::separator() +
+            "Green trace - " + now.toString("yyyyMMddhhmmss") + ".json";
+    const QString name = QFileDialog::getSaveFileName(nullptr, "Save Trace", suggestion);
+    if (name.isEmpty()) return;
+    dump(name);
+}
@@ -0,0 +1,75 @@
+#ifndef GREEN_TRACE_H
+#define GREEN_TRACE_H
+
+#include <QtQml>
+#include <QAtomicInt>
+#include <QObject>
+
+// Lightweight tracing of GDK calls, JSON conversions and other potentially
+// slow operations. Events are kept in per thread ring buffers and can be
+// saved in Chrome trace_event format, see chrome://tracing.
+//
+// Tracing is enabled by setting GREEN_TRACE_FILE, the trace is then written
+// to that file on exit. When disabled a Scope costs a relaxed atomic load.
+namespace Trace {
+
+extern QAtomicInt g_enabled;
+
+inline bool isEnabled() { return g_enabled.loadRelaxed() != 0; }
+
+qint64 now();
+void record(const char* name, qint64 begin, qint64 end, qint64 size);
+
+// Records the lifetime of the scope. The name must be a string literal.
+class Scope
+{
+public:
+    explicit Scope(const char* name, qint64 size = 0)
+        : m_name(isEnabled() ? name : nullptr)
+        , m_size(size)
+        , m_begin(m_name ? now() : 0)
+    {
+    }
+    ~Scope()
+    {
+        if (m_name) record(m_name, m_begin, now(), m_size);
+    }
+    void setSize(qint64 size) { m_size = size; }
+private:
+    Q_DISABLE_COPY(Scope)
+    const char* const m_name;
+    qint64 m_size;
+    const qint64 m_begin;
+};
+
+} // namespace Trace
+
+// Timing of the startup phases, enabled with --startup-timing. Phases are
+// consecutive and measured on the Trace clock, each ends when the next one
+// is marked. The report is printed, or written as JSON to the file given
+// with --startup-timing=<path>.
+namespace Startup {
+
+void enable(const QString& path);
+bool isEnabled();
+// Ends the phase with the given name, which must be a string literal.
+void phase(const char* name);
+// Writes the report and disables further phases.
+void report();
+
+} // namespace Startup
+
+class Tracer : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool enabled READ isEnabled CONSTANT)
+public:
+    static Tracer* instance();
+    bool isEnabled() const { return Trace::isEnabled(); }
+    bool dump(const QString& path) const;
+    Q_INVOKABLE void save() const;
+private:
+    Tracer(QObject* parent = nullptr);
+};
+
+#endif // GREEN_TRACE_H
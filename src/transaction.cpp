@@ -1,5 +1,6 @@
 #include "account.h"
 #include "asset.h"
+#include "executor.h"
 #include "json.h"
 #include "network.h"
 #include "transaction.h"
@@ -7,18 +8,17 @@
 #include <gdk.h>
 
 TransactionAmount::TransactionAmount(Transaction *transaction, qint64 amount)
-    : TransactionAmount(transaction, nullptr, amount)
+    : TransactionAmount(transaction, -1, amount)
 {
 }
 
-TransactionAmount::TransactionAmount(Transaction* transaction, Asset* asset, qint64 amount)
+TransactionAmount::TransactionAmount(Transaction* transaction, int asset_index, qint64 amount)
     : QObject(transaction)
     , m_transaction(transaction)
-    , m_asset(asset)
+    , m_asset_index(asset_index)
     , m_amount(amount)
 {
     Q_ASSERT(m_transaction);
-    Q_ASSERT(!m_asset || m_asset->wallet() == transaction->account()->wallet());
     Q_ASSERT(m_amount > 0);
 }
 
@@ -26,11 +26,16 @@ TransactionAmount::~TransactionAmount()
 {
 }
 
+Asset* TransactionAmount::asset() const
+{
+    return m_asset_index < 0 ? nullptr : m_transaction->account()->wallet()->asset(m_asset_index);
+}
+
 QString TransactionAmount::formatAmount(bool include_ticker) const
 {
     QString prefix = m_transaction->data().value("type").toString() != "incoming" ? "-" : "";
-    if (m_asset) {
-        return prefix + m_asset->formatAmount(m_amount, include_ticker);
+    if (m_asset_index >= 0) {
+        return prefix + asset()->formatAmount(m_amount, include_ticker);
     } else {
         return prefix + m_transaction->account()->wallet()->formatAmount(m_amount, include_ticker);
     }
@@ -77,51 +82,61 @@ void Transaction::updateFromData(const QJsonObject& data)
     // Amounts are one time set
     if (m_amounts.empty()) {
         Wallet* wallet = m_account->wallet();
-        const auto satoshi = m_data.value("satoshi").toObject();
-        const int count = satoshi.keys().length();
+        for (const auto& amount : amountsFromData(m_data, wallet->network()->isLiquid())) {
+            if (amount.first.isEmpty()) {
+                m_amounts.append(new TransactionAmount(this, amount.second));
+            } else {
+                m_amounts.append(new TransactionAmount(this, wallet->assetIndex(amount.first), amount.second));
+            }
+        }
 
-        if (wallet->network()->isLiquid()) {
-            const QString type = data.value("type").toString();
+        emit amountsChanged();
+    }
+}
+
+QList<QPair<QString, qint64>> Transaction::amountsFromData(const QJsonObject& data, bool liquid)
+{
+    QList<QPair<QString, qint64>> amounts;
+    const auto satoshi = data.value("satoshi").toObject();
+    const int count = satoshi.keys().length();
 
-            if (type == "redeposit") {
+    if (liquid) {
+        const QString type = data.value("type").toString();
+
+        if (type == "redeposit") {
+            Q_ASSERT(satoshi.contains("btc"));
+            qint64 amount = satoshi.value("btc").toDouble();
+            amounts.append({ QString(), amount });
+        } else if (type == "incoming") {
+            for (auto i = satoshi.constBegin(); i != satoshi.constEnd(); ++i) {
+                qint64 amount = i.value().toDouble();
+                amounts.append({ i.key(), amount });
+            }
+        } else if (type == "outgoing") {
+            if (count == 1) {
                 Q_ASSERT(satoshi.contains("btc"));
                 qint64 amount = satoshi.value("btc").toDouble();
-                m_amounts.append(new TransactionAmount(this, amount));
-            } else if (type == "incoming") {
+                amounts.append({ "btc", amount });
+            } else {
                 for (auto i = satoshi.constBegin(); i != satoshi.constEnd(); ++i) {
-                    Asset* asset = wallet->getOrCreateAsset(i.key());
                     qint64 amount = i.value().toDouble();
-                    m_amounts.append(new TransactionAmount(this, asset, amount));
-                }
-            } else if (type == "outgoing") {
-                if (count == 1) {
-                    Q_ASSERT(satoshi.contains("btc"));
-                    auto asset = wallet->getOrCreateAsset("btc");
-                    qint64 amount = satoshi.value("btc").toDouble();
-                    m_amounts.append(new TransactionAmount(this, asset, amount));
-                } else {
-                    for (auto i = satoshi.constBegin(); i != satoshi.constEnd(); ++i) {
-                        qint64 amount = i.value().toDouble();
-                        if (i.key() == "btc") {
-                            qint64 fee = data.value("fee").toDouble();
-                            Q_ASSERT(fee <= amount);
-                            amount -= fee;
-                            if (amount == 0) continue; // just fee
-                        }
-                        Asset* asset = wallet->getOrCreateAsset(i.key());
-                        m_amounts.append(new TransactionAmount(this, asset, amount));
+                    if (i.key() == "btc") {
+                        qint64 fee = data.value("fee").toDouble();
+                        Q_ASSERT(fee <= amount);
+                        amount -= fee;
+                        if (amount == 0) continue; // just fee
                     }
+                    amounts.append({ i.key(), amount });
                 }
-            } else {
-                Q_UNREACHABLE();
             }
         } else {
-            qint64 amount = satoshi.value("btc").toDouble();
-            m_amounts.append(new TransactionAmount(this, amount));
+            Q_UNREACHABLE();
         }
-
-        emit amountsChanged();
+    } else {
+        qint64 amount = satoshi.value("btc").toDouble();
+        amounts.append({ QString(), amount });
     }
+    return amounts;
 }
 
 void Transaction::openInExplorer() const
@@ -135,7 +150,7 @@ void Transaction::updateMemo(const QString &memo)
 
     Q_ASSERT(memo.length() <= 1024);
 
-    QMetaObject::invokeMethod(m_account->m_wallet->m_context, [this, memo] {
+    m_account->m_wallet->m_context->post([this, memo] {
         auto txhash = m_data.value("txhash").toString().toLocal8Bit();
         int err = GA_set_transaction_memo(m_account->m_wallet->m_session, txhash.constData(), memo.toLocal8Bit().constData(), GA_MEMO_USER);
         Q_ASSERT(err == GA_OK);
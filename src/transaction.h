@@ -19,12 +19,12 @@ class TransactionAmount : public QObject
     QML_UNCREATABLE("TransactionAmount is instanced by Transaction.")
 public:
     explicit TransactionAmount(Transaction* transaction, qint64 amount);
-    explicit TransactionAmount(Transaction* transaction, Asset* asset, qint64 amount);
+    explicit TransactionAmount(Transaction* transaction, int asset_index, qint64 amount);
     virtual ~TransactionAmount();
 
     Transaction* transaction() const { return m_transaction; }
 
-    Asset* asset() const { return m_asset; }
+    Asset* asset() const;
 
     qint64 amount() const { return m_amount; }
 
@@ -32,7 +32,8 @@ public:
 
 private:
     Transaction* const m_transaction;
-    Asset* const m_asset;
+    // Index in the asset table of the wallet, -1 if not a Liquid amount.
+    int const m_asset_index;
     qint64 const m_amount;
 };
 
@@ -58,6 +59,10 @@ public:
 
     void updateFromData(const QJsonObject& data);
 
+    // Amounts of the given transaction data as (asset id, amount) pairs. The
+    // asset id is empty for amounts in the network's native unit.
+    static QList<QPair<QString, qint64>> amountsFromData(const QJsonObject& data, bool liquid);
+
 public slots:
     void openInExplorer() const;
     void updateMemo(const QString& memo);
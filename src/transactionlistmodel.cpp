@@ -0,0 +1,179 @@
+#include "account.h"
+#include "transaction.h"
+#include "transactionlistmodel.h"
+
+#include <QHash>
+#include <QSet>
+
+#include <algorithm>
+
+namespace {
+
+const int PAGE_SIZE = 50;
+
+} // namespace
+
+TransactionListModel::TransactionListModel(QObject* parent)
+    : QAbstractListModel(parent)
+{
+}
+
+void TransactionListModel::setAccount(Account* account)
+{
+    if (m_account == account) return;
+    beginResetModel();
+    if (m_account) disconnect(m_account, nullptr, this, nullptr);
+    for (auto transaction : m_transactions) {
+        disconnect(transaction, nullptr, this, nullptr);
+    }
+    m_transactions.clear();
+    m_account = account;
+    if (m_account) {
+        connect(m_account, &Account::transactionsChanged, this, &TransactionListModel::update);
+        connect(m_account, &QObject::destroyed, this, [this] {
+            beginResetModel();
+            m_account = nullptr;
+            m_transactions.clear();
+            endResetModel();
+            emit accountChanged(nullptr);
+        });
+        const int count = std::min(PAGE_SIZE, m_account->m_transactions.size());
+        for (int row = 0; row < count; ++row) {
+            insert(row, m_account->m_transactions.at(row));
+        }
+    }
+    endResetModel();
+    emit accountChanged(m_account);
+}
+
+int TransactionListModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid()) return 0;
+    return m_transactions.size();
+}
+
+QVariant TransactionListModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_transactions.size()) return {};
+    Transaction* transaction = m_transactions.at(index.row());
+    switch (role) {
+    case TransactionRole: return QVariant::fromValue(transaction);
+    case HashRole: return transaction->data().value("txhash").toString();
+    case TypeRole: return transaction->data().value("type").toString();
+    case CreatedAtRole: return transaction->data().value("created_at").toString();
+    case MemoRole: return transaction->data().value("memo").toString();
+    case BlockHeightRole: return transaction->data().value("block_height").toInt();
+    default: return {};
+    }
+}
+
+QHash<int, QByteArray> TransactionListModel::roleNames() const
+{
+    return {
+        { TransactionRole, "transaction" },
+        { HashRole, "txhash" },
+        { TypeRole, "type" },
+        { CreatedAtRole, "createdAt" },
+        { MemoRole, "memo" },
+        { BlockHeightRole, "blockHeight" }
+    };
+}
+
+bool TransactionListModel::canFetchMore(const QModelIndex& parent) const
+{
+    if (parent.isValid() || !m_account) return false;
+    return m_transactions.size() < m_account->m_transactions.size();
+}
+
+void TransactionListModel::fetchMore(const QModelIndex& parent)
+{
+    if (!canFetchMore(parent)) return;
+    const int first = m_transactions.size();
+    const int last = std::min(first + PAGE_SIZE, m_account->m_transactions.size()) - 1;
+    beginInsertRows(QModelIndex(), first, last);
+    for (int row = first; row <= last; ++row) {
+        insert(row, m_account->m_transactions.at(row));
+    }
+    endInsertRows();
+}
+
+void TransactionListModel::update()
+{
+    Q_ASSERT(m_account);
+    const auto& transactions = m_account->m_transactions;
+
+    // The materialized rows must stay materialized, so the new prefix extends
+    // at least up to the last of them, new transactions push them down.
+    QHash<Transaction*, int> position;
+    position.reserve(transactions.size());
+    for (int index = 0; index < transactions.size(); ++index) {
+        position.insert(transactions.at(index), index);
+    }
+    int size = std::min(transactions.size(), std::max(PAGE_SIZE, m_transactions.size()));
+    for (auto transaction : m_transactions) {
+        size = std::max(size, position.value(transaction, -1) + 1);
+    }
+    const auto target = transactions.mid(0, size);
+    QSet<Transaction*> keep;
+    for (auto transaction : target) keep.insert(transaction);
+
+    // Remove rows that are gone, in contiguous runs from the end.
+    for (int last = m_transactions.size() - 1; last >= 0; --last) {
+        if (keep.contains(m_transactions.at(last))) continue;
+        int first = last;
+        while (first > 0 && !keep.contains(m_transactions.at(first - 1))) --first;
+        beginRemoveRows(QModelIndex(), first, last);
+        for (int row = last; row >= first; --row) {
+            disconnect(m_transactions.at(row), nullptr, this, nullptr);
+            m_transactions.remove(row);
+        }
+        endRemoveRows();
+        last = first;
+    }
+
+    QSet<Transaction*> current;
+    for (auto transaction : m_transactions) current.insert(transaction);
+
+    // Insert new rows in contiguous runs and move the ones that changed place.
+    for (int row = 0; row < target.size(); ++row) {
+        Transaction* transaction = target.at(row);
+        if (row < m_transactions.size() && m_transactions.at(row) == transaction) continue;
+        if (!current.contains(transaction)) {
+            int last = row;
+            while (last + 1 < target.size() && !current.contains(target.at(last + 1))) ++last;
+            beginInsertRows(QModelIndex(), row, last);
+            for (int index = row; index <= last; ++index) {
+                insert(index, target.at(index));
+                current.insert(target.at(index));
+            }
+            endInsertRows();
+            row = last;
+            continue;
+        }
+        const int from = m_transactions.indexOf(transaction, row);
+        Q_ASSERT(from > row);
+        beginMoveRows(QModelIndex(), from, from, QModelIndex(), row);
+        m_transactions.move(from, row);
+        endMoveRows();
+    }
+    Q_ASSERT(m_transactions == target);
+}
+
+void TransactionListModel::insert(int row, Transaction* transaction)
+{
+    m_transactions.insert(row, transaction);
+    connect(transaction, &Transaction::dataChanged, this, [this, transaction] {
+        transactionChanged(transaction);
+    });
+    connect(transaction, &Transaction::amountsChanged, this, [this, transaction] {
+        transactionChanged(transaction);
+    });
+}
+
+void TransactionListModel::transactionChanged(Transaction* transaction)
+{
+    const int row = m_transactions.indexOf(transaction);
+    if (row < 0) return;
+    const auto index = this->index(row);
+    emit dataChanged(index, index);
+}
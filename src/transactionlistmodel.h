@@ -0,0 +1,53 @@
+#ifndef GREEN_TRANSACTIONLISTMODEL_H
+#define GREEN_TRANSACTIONLISTMODEL_H
+
+#include <QtQml>
+#include <QAbstractListModel>
+#include <QVector>
+
+class Account;
+class Transaction;
+
+class TransactionListModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(Account* account READ account WRITE setAccount NOTIFY accountChanged)
+    QML_ELEMENT
+public:
+    enum Roles {
+        TransactionRole = Qt::UserRole,
+        HashRole,
+        TypeRole,
+        CreatedAtRole,
+        MemoRole,
+        BlockHeightRole
+    };
+
+    explicit TransactionListModel(QObject* parent = nullptr);
+
+    Account* account() const { return m_account; }
+    void setAccount(Account* account);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+
+signals:
+    void accountChanged(Account* account);
+
+private slots:
+    void update();
+
+private:
+    void insert(int row, Transaction* transaction);
+    void transactionChanged(Transaction* transaction);
+
+    Account* m_account{nullptr};
+    // Rows materialized so far, always a prefix of the account transactions.
+    QVector<Transaction*> m_transactions;
+};
+
+#endif // GREEN_TRANSACTIONLISTMODEL_H
@@ -1,6 +1,7 @@
 #include "util.h"
 
 #include <QDir>
+#include <QFileDevice>
 #include <QStandardPaths>
 
 QString GetDataDir(const QString& context)
@@ -16,3 +17,8 @@ QString GetDataFile(const QString& context, const QString& name)
 {
     return GetDataDir(context) + QDir::separator() + name;
 }
+
+bool SetOwnerOnly(QFileDevice& file)
+{
+    return file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+}
@@ -3,7 +3,12 @@
 
 #include <QString>
 
+class QFileDevice;
+
 QString GetDataDir(const QString& context);
 QString GetDataFile(const QString& context, const QString& name);
 
+// Restricts an open file to the current user, for files holding wallet data.
+bool SetOwnerOnly(QFileDevice& file);
+
 #endif // GREEN_UTIL_H
@@ -1,55 +1,157 @@
 #include "account.h"
+#include "amount.h"
 #include "asset.h"
+#include "assetcache.h"
+#include "executor.h"
 #include "ga.h"
 #include "json.h"
 #include "network.h"
+#include "transaction.h"
 #include "util.h"
 #include "wallet.h"
+#include "walletcache.h"
+#include "walletmanager.h"
 
-#include <QDateTime>
+#include <QCoreApplication>
 #include <QDebug>
+#include <QDir>
+#include <QFileDialog>
 #include <QJsonObject>
 #include <QLocale>
+#include <QPointer>
+#include <QSaveFile>
 #include <QSettings>
+#include <QStandardPaths>
 #include <QTimer>
 #include <QUuid>
 
 #include <gdk.h>
 
+#include <queue>
+
 static void notification_handler(void* context, const GA_json* details)
 {
     Wallet* wallet = static_cast<Wallet*>(context);
-    auto notification = Json::toObject(details);
-    QMetaObject::invokeMethod(wallet, [wallet, notification] {
-        wallet->handleNotification(notification);
-    });
+    wallet->queueNotification(Json::toObject(details));
 }
 
+namespace {
 
-Wallet::Wallet(QObject *parent)
-    : QObject(parent)
+const QString LBTC_ID = QStringLiteral("6f0279e9ed041c3d710a9f57d0c02928416460c4b722ae3457a11eec381c526d");
+const int ASSET_ID_SIZE = 32;
+
+// Asset ids are interned by their binary value, other ids like "btc" are
+// kept as is and can't collide since they are shorter.
+QByteArray assetKey(const QString& id)
 {
-    // TODO: instantiate only if needed
-    m_thread = new QThread(this);
-    m_context = new QObject;
+    const auto bytes = id.toLatin1();
+    return bytes.size() == 2 * ASSET_ID_SIZE ? QByteArray::fromHex(bytes) : bytes;
+}
 
-    m_context->moveToThread(m_thread);
-    m_thread->start();
+// Asset metadata needed to export amounts, copied from Asset objects so
+// that rows can be built off the wallet thread.
+struct ExportAsset
+{
+    QString ticker;
+    int precision;
+    bool lbtc;
+};
+
+// Merges the given histories, each sorted newest first, into rows sorted
+// newest first. Unconfirmed transactions are skipped.
+QVector<ExportRow> mergeHistories(const QVector<QPair<int, QJsonArray>>& histories, const QHash<QString, ExportAsset>& assets, const QString& unit, bool liquid)
+{
+    using Cursor = QPair<QString, int>; // created_at, history index
+    auto compare = [](const Cursor& a, const Cursor& b) { return a.first < b.first; };
+    std::priority_queue<Cursor, std::vector<Cursor>, decltype(compare)> heap(compare);
+    QVector<int> positions(histories.size(), 0);
+
+    int count = 0;
+    for (int i = 0; i < histories.size(); ++i) {
+        const auto& transactions = histories.at(i).second;
+        count += transactions.size();
+        if (!transactions.isEmpty()) {
+            heap.push({ transactions.at(0).toObject().value("created_at").toString(), i });
+        }
+    }
 
-    QMetaObject::invokeMethod(m_context, [this] {
-        auto timer = new QTimer;
-        timer->start(100);
-        QObject::connect(timer, &QTimer::timeout, [this] {
-            m_last_timestamp = QDateTime::currentMSecsSinceEpoch();
-        });
+    QVector<ExportRow> rows;
+    rows.reserve(count);
+    while (!heap.empty()) {
+        const int i = heap.top().second;
+        heap.pop();
+        const int pointer = histories.at(i).first;
+        const auto& transactions = histories.at(i).second;
+        const auto data = transactions.at(positions[i]).toObject();
+        if (++positions[i] < transactions.size()) {
+            heap.push({ transactions.at(positions[i]).toObject().value("created_at").toString(), i });
+        }
+
+        if (data.value("block_height").toInt() == 0) continue;
+        const auto type = data.value("type").toString();
+        for (const auto& amount : Transaction::amountsFromData(data, liquid)) {
+            const bool is_btc = amount.first.isEmpty() || amount.first == "btc" || assets.value(amount.first).lbtc;
+            ExportRow row;
+            row.time = data.value("created_at").toString();
+            row.description = type;
+            row.txhash = data.value("txhash").toString();
+            row.memo = data.value("memo").toString().replace("\n", " ").replace(",", "-");
+            row.subaccount = pointer;
+            row.amount = amount.second;
+            row.negative = type != "incoming";
+            row.fee = type == "outgoing" ? data.value("fee").toInt() : -1;
+            if (is_btc) {
+                row.unit = liquid ? "L-" + unit : unit;
+                row.decimals = Amount::decimals(unit);
+                row.fiat = true;
+            } else {
+                const auto asset = assets.value(amount.first, { amount.first, 0, false });
+                row.unit = asset.ticker.isEmpty() ? amount.first : asset.ticker;
+                row.decimals = asset.precision;
+                row.trim = false;
+            }
+            rows.append(row);
+        }
+    }
+    return rows;
+}
+
+} // namespace
+
+
+Wallet::Wallet(QObject *parent)
+    : QObject(parent)
+    , m_context(new Executor)
+    , m_busy_timer(new QTimer(this))
+    , m_notification_timer(new QTimer(this))
+    , m_fee_estimates(new FeeEstimates(this))
+{
+    // Notifications received within the interval are handled in one pass.
+    m_notification_timer->setSingleShot(true);
+    m_notification_timer->setInterval(100);
+    QObject::connect(m_notification_timer, &QTimer::timeout, this, [this] {
+        QList<QJsonObject> notifications;
+        {
+            QMutexLocker locker(&m_notifications_mutex);
+            notifications.swap(m_notifications);
+        }
+        handleNotifications(notifications);
     });
 
-    auto timer = new QTimer(this);
-    timer->start(100);
-    QObject::connect(timer, &QTimer::timeout, [this] {
-        qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
-        setBusy(timestamp - m_last_timestamp > 300);
+    // Only report busy if GDK calls are pending for a noticeable time.
+    m_busy_timer->setSingleShot(true);
+    m_busy_timer->setInterval(300);
+    QObject::connect(m_busy_timer, &QTimer::timeout, this, [this] {
+        setBusy(true);
     });
+    QObject::connect(m_context, &Executor::busyChanged, this, [this](bool busy) {
+        if (busy) {
+            if (!m_busy_timer->isActive()) m_busy_timer->start();
+        } else {
+            m_busy_timer->stop();
+            setBusy(false);
+        }
+    }, Qt::QueuedConnection);
 }
 
 void Wallet::connect(const QString& proxy, bool use_tor)
@@ -83,7 +185,7 @@ void Wallet::connectNow()
 
     if (m_connection == Disconnected) return;
 
-    QMetaObject::invokeMethod(m_context, [this] {
+    m_context->post([this] {
         QJsonObject params{
             { "name", m_network->id() },
 #ifdef QT_DEBUG
@@ -132,7 +234,7 @@ void Wallet::disconnect()
     if (m_logout_timer != -1 ) {
         killTimer(m_logout_timer);
         m_logout_timer = -1;
-        qApp->removeEventFilter(this);
+        QCoreApplication::instance()->removeEventFilter(this);
     }
 
     setCurrentAccount(nullptr);
@@ -145,37 +247,55 @@ void Wallet::disconnect()
     m_config = {};
     m_currencies = {};
     m_events = {};
+    m_fee_estimates->clear();
+    m_balance_requests.clear();
+    m_fiat_rate.clear();
+    m_fiat_currency.clear();
+    emit fiatRateChanged();
+    m_ticker_pushed = false;
+    cancelExports();
 
     setConnection(Disconnected);
     setAuthentication(Unauthenticated);
 
-    QMetaObject::invokeMethod(m_context, [this] {
+    m_context->run([this] {
         int err = GA_destroy_session(m_session);
         Q_ASSERT(err == GA_OK);
         m_session = nullptr;
-    }, Qt::BlockingQueuedConnection);
+        // Assets are reloaded from the cache on the next login. The cache
+        // is only used by executor tasks, it's kept until ~Wallet.
+        if (m_asset_cache) m_asset_cache->reset();
+    });
+
+    // Drop notifications of the destroyed session.
+    m_notification_timer->stop();
+    {
+        QMutexLocker locker(&m_notifications_mutex);
+        m_notifications.clear();
+    }
 
     qDeleteAll(accounts);
-    qDeleteAll(m_assets.values());
+    qDeleteAll(m_assets);
     m_assets.clear();
+    m_asset_indexes.clear();
 }
 
 Wallet::~Wallet()
 {
+    cancelExports();
     if (m_session) {
-        QMetaObject::invokeMethod(m_context, [this] {
+        m_context->run([this] {
             int res = GA_disconnect(m_session);
             Q_ASSERT(res == GA_OK);
 
             res = GA_destroy_session(m_session);
             Q_ASSERT(res == GA_OK);
-        }, Qt::BlockingQueuedConnection);
-    }
-    if (m_thread) {
-        m_context->deleteLater();
-        m_thread->quit();
-        m_thread->wait();
+        });
     }
+    // Waits for pending tasks.
+    delete m_context;
+    delete m_cache;
+    delete m_asset_cache;
 }
 
 void Wallet::setNetwork(Network* network)
@@ -207,109 +327,162 @@ QQmlListProperty<Account> Wallet::accounts()
     return { this, &m_accounts };
 }
 
-void Wallet::handleNotification(const QJsonObject &notification)
+void Wallet::queueNotification(const QJsonObject& notification)
 {
-    QString event = notification.value("event").toString();
-    Q_ASSERT(!event.isEmpty());
-
-    QJsonValue data = notification.value(event);
-
-    m_events.insert(event, data);
-    emit eventsChanged(m_events);
-
-    if (event == "session") {
-        bool connected = data.toObject().value("connected").toBool();
-        setConnection(connected ? Connected : m_connection);
-        return;
+    // Called from GDK threads, the first notification of a batch starts the
+    // timer on the wallet thread.
+    bool first;
+    {
+        QMutexLocker locker(&m_notifications_mutex);
+        first = m_notifications.isEmpty();
+        m_notifications.append(notification);
+    }
+    if (first) {
+        QMetaObject::invokeMethod(this, [this] {
+            m_notification_timer->start();
+        }, Qt::QueuedConnection);
     }
+}
 
-    if (event == "network") {
-        QJsonObject network = data.toObject();
-        if (!network.value("connected").toBool()) {
-            setConnection(Connecting);
-            return;
+void Wallet::handleNotifications(const QList<QJsonObject>& notifications)
+{
+    // Events of the same kind are coalesced: state events only need the last
+    // value, transaction events only need the set of affected accounts.
+    QMap<QString, QJsonObject> latest;
+    QSet<Account*> transaction_accounts;
+    QJsonArray fees;
+    bool events_changed = false;
+    for (const auto& notification : notifications) {
+        QString event = notification.value("event").toString();
+        Q_ASSERT(!event.isEmpty());
+
+        QJsonValue data = notification.value(event);
+
+        // Fee estimates are kept apart, so that they don't cause bindings
+        // on events to be reevaluated.
+        if (event == "fees") {
+            fees = data.toArray();
+            continue;
         }
 
-        setConnection(Connected);
-        if (network.value("login_required").toBool()) {
-            setAuthentication(Unauthenticated);
-        } else {
-            setAuthentication(Authenticated);
-        }
-        return;
-    }
+        m_events.insert(event, data);
+        events_changed = true;
 
-    if (event == "transaction") {
-        // This set contains all accounts that have to be updated due
-        // to the received transaction event.
-        QSet<Account*> accounts;
+        if (event == "transaction") {
+            for (auto pointer : data.toObject().value("subaccounts").toArray()) {
+                auto account = m_accounts_by_pointer.value(pointer.toInt());
+                if (account) transaction_accounts.insert(account);
+            }
+            continue;
+        }
 
-        QJsonObject transaction = data.toObject();
-        for (auto pointer : transaction.value("subaccounts").toArray()) {
-            auto account = m_accounts_by_pointer.value(pointer.toInt());
-            account->handleNotification(notification);
-            accounts.insert(account);
+        if (event == "session" || event == "network" || event == "settings" || event == "twofactor_reset" ||
+            event == "ticker" || event == "block") {
+            latest.insert(event, data.toObject());
+            continue;
         }
 
-        QMetaObject::invokeMethod(m_context, [this, accounts] {
-            // First get balance for each account.
-            for (auto account : accounts) {
-                auto result = GA::process_auth([=] (GA_auth_handler** call) {
-                    GA_json* details = Json::fromObject({
-                        { "subaccount", account->m_pointer },
-                        { "num_confs", 0 }
-                    });
-
-                    int err = GA_get_balance(m_session, details, call);
-                    Q_ASSERT(err == GA_OK);
-                    GA_destroy_json(details);
-                });
+        qDebug() << "UNHANDLED NOTIFICATION" << notification;
+    }
 
-                Q_ASSERT(result.value("status").toString() == "done");
-                auto balance = result.value("result").toObject();
+    if (events_changed) emit eventsChanged(m_events);
 
-                // TODO: handle m_json concurrency
-                account->m_json.insert("satoshi", balance);
-            }
+    if (latest.contains("session")) {
+        bool connected = latest.value("session").value("connected").toBool();
+        setConnection(connected ? Connected : m_connection);
+    }
 
-            QMetaObject::invokeMethod(this, [=] {
-                // Now update all account balances at once.
-                for (auto account : accounts) {
-                    emit account->jsonChanged();
-                    account->updateBalance();
-                }
-            }, Qt::QueuedConnection);
-        });
+    if (latest.contains("network")) {
+        QJsonObject network = latest.value("network");
+        if (!network.value("connected").toBool()) {
+            setConnection(Connecting);
+        } else {
+            setConnection(Connected);
+            if (network.value("login_required").toBool()) {
+                setAuthentication(Unauthenticated);
+            } else {
+                setAuthentication(Authenticated);
+            }
+        }
+    }
 
-        return;
+    if (latest.contains("settings")) {
+        setSettings(latest.value("settings"));
     }
 
-    if (event == "settings") {
-        setSettings(data.toObject());
-        return;
+    if (latest.contains("twofactor_reset")) {
+        setLocked(latest.value("twofactor_reset").value("is_active").toBool());
     }
 
-    if (event == "twofactor_reset") {
-        setLocked(data.toObject().value("is_active").toBool());
-        return;
+    if (!fees.isEmpty()) {
+        m_fee_estimates->update(fees);
     }
 
-    if (event == "fees") {
-        // TODO: fees are being used in QML as `event.fees`.
-        return;
+    // Exchange rates aren't pushed by every backend, refresh them along
+    // with new blocks only until a ticker notification arrives.
+    if (latest.contains("ticker")) m_ticker_pushed = true;
+    if (latest.contains("ticker") || (latest.contains("block") && !m_ticker_pushed)) {
+        updateFiatRate();
     }
 
-    if (event == "block") {
+    // Each affected account gets one incremental reload per batch, either
+    // because it received a transaction or because it has unconfirmed ones.
+    QSet<Account*> reload_accounts = transaction_accounts;
+    if (latest.contains("block")) {
         for (auto account : m_accounts) {
-            if (account->m_have_unconfirmed) {
-                // reloading all transactions if at least one transaction is unconfirmed.
-                account->reload();
-            }
+            if (account->m_have_unconfirmed) reload_accounts.insert(account);
         }
-        return;
+    }
+    for (auto account : reload_accounts) {
+        account->reload();
     }
 
-    qDebug() << "UNHANDLED NOTIFICATION" << notification;
+    QSet<int> pointers;
+    for (auto account : transaction_accounts) pointers.insert(account->m_pointer);
+    refreshBalances(pointers);
+}
+
+void Wallet::refreshBalances(const QSet<int>& pointers)
+{
+    // Requests made while a refresh is running are merged and handled by a
+    // single follow up refresh.
+    m_balance_requests.unite(pointers);
+    if (m_balance_refresh_pending || m_balance_requests.isEmpty()) return;
+    m_balance_refresh_pending = true;
+
+    QSet<int> requests;
+    requests.swap(m_balance_requests);
+
+    m_context->post([this, requests] {
+        // Balances are collected into a snapshot owned by this task, accounts
+        // are only touched on the wallet thread.
+        QMap<int, QJsonObject> balances;
+        for (int pointer : requests) {
+            auto result = GA::process_auth([=] (GA_auth_handler** call) {
+                GA_json* details = Json::fromObject({
+                    { "subaccount", pointer },
+                    { "num_confs", 0 }
+                });
+
+                int err = GA_get_balance(m_session, details, call);
+                Q_ASSERT(err == GA_OK);
+                GA_destroy_json(details);
+            });
+
+            Q_ASSERT(result.value("status").toString() == "done");
+            balances.insert(pointer, result.value("result").toObject());
+        }
+
+        QMetaObject::invokeMethod(this, [this, balances] {
+            // Now update all account balances at once.
+            for (auto i = balances.constBegin(); i != balances.constEnd(); ++i) {
+                auto account = m_accounts_by_pointer.value(i.key());
+                if (account) account->setBalance(i.value());
+            }
+            m_balance_refresh_pending = false;
+            refreshBalances({});
+        }, Qt::QueuedConnection);
+    });
 }
 
 QJsonObject Wallet::events() const
@@ -320,13 +493,13 @@ QJsonObject Wallet::events() const
 QStringList Wallet::mnemonic() const
 {
     QStringList result;
-    QMetaObject::invokeMethod(m_context, [this, &result] {
+    m_context->run([this, &result] {
         char* mnemonic = nullptr;
         int err = GA_get_mnemonic_passphrase(m_session, "", &mnemonic);
         Q_ASSERT(err == GA_OK);
         result = QString(mnemonic).split(' ');
         GA_destroy_string(mnemonic);
-    }, Qt::BlockingQueuedConnection);
+    });
     return result;
 }
 
@@ -354,11 +527,12 @@ void Wallet::loginWithPin(const QByteArray& pin)
 {
     Q_ASSERT(m_login_attempts_remaining > 0);
 
+    loadPinData();
     if (m_pin_data.isEmpty()) return;
 
     setAuthentication(Authenticating);
 
-    QMetaObject::invokeMethod(m_context, [this, pin] {
+    m_context->post([this, pin] {
         auto result = GA::process_auth([this, pin] (GA_auth_handler** call) {
             GA_json* pin_data;
             int err = GA_convert_string_to_json(m_pin_data.constData(), &pin_data);
@@ -378,13 +552,13 @@ void Wallet::loginWithPin(const QByteArray& pin)
                     --m_login_attempts_remaining;
                     save();
                     emit loginAttemptsRemainingChanged(m_login_attempts_remaining);
-                }, Qt::BlockingQueuedConnection);
+                }, Qt::QueuedConnection);
                 return;
             }
             if (error.contains("exception:reconnect required")) {
                 QMetaObject::invokeMethod(this, [this] {
                     setAuthentication(Unauthenticated);
-                }, Qt::BlockingQueuedConnection);
+                }, Qt::QueuedConnection);
                 return;
             }
             Q_UNREACHABLE();
@@ -399,9 +573,10 @@ void Wallet::loginWithPin(const QByteArray& pin)
             setAuthentication(Authenticated);
             updateCurrencies();
             updateSettings();
+            loadCache();
             reload();
             updateConfig();
-        }, Qt::BlockingQueuedConnection);
+        }, Qt::QueuedConnection);
     });
 }
 
@@ -411,7 +586,7 @@ void Wallet::signup(const QStringList& mnemonic, const QByteArray& pin)
 
     setAuthentication(Authenticating);
 
-    QMetaObject::invokeMethod(m_context, [this, pin, mnemonic] {
+    m_context->post([this, pin, mnemonic] {
         QByteArray raw_mnemonic = mnemonic.join(' ').toLatin1();
 
         GA_json* hw_device;
@@ -443,7 +618,7 @@ void Wallet::signup(const QStringList& mnemonic, const QByteArray& pin)
 
         QMetaObject::invokeMethod(this, [this]{
             save();
-        }, Qt::BlockingQueuedConnection);
+        }, Qt::QueuedConnection);
 
         updateCurrencies();
         reload();
@@ -459,7 +634,7 @@ void Wallet::login(const QStringList& mnemonic, const QString& password)
 
     setAuthentication(Authenticating);
 
-    QMetaObject::invokeMethod(m_context, [this, mnemonic, password] {
+    m_context->post([this, mnemonic, password] {
         QByteArray raw_mnemonic = mnemonic.join(' ').toLatin1();
 
         GA_json* hw_device;
@@ -488,7 +663,7 @@ void Wallet::setPin(const QByteArray& pin)
     Q_ASSERT(m_name.isEmpty());
     Q_ASSERT(m_pin_data.isEmpty());
 
-    QMetaObject::invokeMethod(m_context, [this, pin] {
+    m_context->post([this, pin] {
         char* mnemonic;
         int err = GA_get_mnemonic_passphrase(m_session, "", &mnemonic);
         Q_ASSERT(err == GA_OK);
@@ -503,9 +678,11 @@ void Wallet::setPin(const QByteArray& pin)
 
 void Wallet::reload()
 {
-    QMetaObject::invokeMethod(m_context, [this] {
+    m_context->post([this] {
         QJsonArray accounts = GA::get_subaccounts(m_session);
 
+        if (m_cache) m_cache->appendSubaccounts(accounts);
+
         QMetaObject::invokeMethod(this, [this, accounts] {
             quint64 balance  = 0;
 
@@ -534,19 +711,128 @@ void Wallet::reload()
                 m_has_liquid_securities = true;
                 emit hasLiquidSecuritiesChanged(true);
             }
+
+            // Queued after the account reloads so that these don't wait
+            // for the registry download.
+            if (m_network->isLiquid()) {
+                refreshAssets();
+            }
         });
+    });
+}
 
-        if (m_network->isLiquid()) {
-            refreshAssets();
+ExportJob* Wallet::exportTransactions(ExportJob::Format format)
+{
+    Q_ASSERT(m_authentication == Authenticated);
+
+    const auto now = QDateTime::currentDateTime();
+    const QString suggestion =
+            QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation) + QDir::separator() +
+            m_name + " - " + now.toString("yyyyMMddhhmmss") + "." + ExportJob::suffix(format);
+    const QString name = QFileDialog::getSaveFileName(nullptr, "Export Transactions", suggestion);
+    if (name.isEmpty()) return nullptr;
+
+    const auto pricing = m_settings.value("pricing").toObject();
+    const auto unit = m_settings.value("unit").toString();
+    const bool liquid = m_network->isLiquid();
+
+    ExportJob::Options options;
+    options.format = format;
+    options.header = QStringList{
+        "time", "description", "amount", "unit",
+        QString("fee (%1)").arg(liquid ? "L-" + unit : unit),
+        QString("fiat (%1 %2 %3)").arg(pricing.value("currency").toString()).arg(pricing.value("exchange").toString(), now.toString(Qt::ISODate)),
+        "txhash", "memo"
+    };
+    options.subaccount = true;
+    options.fiat_rate = m_fiat_rate.toDouble();
+    options.fee_decimals = Amount::decimals(unit);
+
+    QVector<int> pointers;
+    for (auto account : m_accounts) pointers.append(account->m_pointer);
+
+    QHash<QString, ExportAsset> assets;
+    for (auto asset : m_assets) {
+        const auto data = asset->data();
+        assets.insert(asset->id(), { data.value("ticker").toString(), data.value("precision").toInt(0), asset->isLBTC() });
+    }
+
+    auto job = new ExportJob(name, options, this);
+    QQmlEngine::setObjectOwnership(job, QQmlEngine::CppOwnership);
+
+    // The whole history of every account is fetched, regardless of what is
+    // loaded. GDK calls of a session are serialized on the wallet executor,
+    // so accounts are fetched in turn and the merge runs on the same task.
+    // The task only holds the cancel flag, which disconnect() also sets so
+    // that it doesn't wait for the whole history.
+    QPointer<ExportJob> guard(job);
+    const auto canceled = job->cancelFlag();
+    m_exports.append(canceled);
+    m_context->post([this, guard, canceled, pointers, assets, unit, liquid] {
+        QVector<QPair<int, QJsonArray>> histories;
+        for (int pointer : pointers) {
+            QJsonArray transactions;
+            const int count = 30;
+            for (int first = 0; !canceled->loadRelaxed(); first += count) {
+                const auto values = GA::get_transactions(m_session, pointer, first, count);
+                for (const auto& value : values) transactions.append(value);
+                if (values.size() < count) break;
+            }
+            histories.append({ pointer, transactions });
         }
+
+        auto rows = canceled->loadRelaxed() ? QVector<ExportRow>() : mergeHistories(histories, assets, unit, liquid);
+
+        QMetaObject::invokeMethod(this, [this, guard, canceled, rows] {
+            m_exports.removeOne(canceled);
+            if (guard) guard->start(rows);
+        }, Qt::QueuedConnection);
     });
+
+    return job;
+}
+
+void Wallet::cancelExports()
+{
+    for (const auto& canceled : m_exports) canceled->storeRelaxed(1);
+    m_exports.clear();
+}
+
+void Wallet::loadCache()
+{
+    // Show the last known state while the wallet is reloaded from GDK.
+    if (m_id.isEmpty()) return;
+    if (!m_cache) m_cache = new WalletCache(m_id);
+
+    const auto data = m_cache->load();
+    if (data.subaccounts.isEmpty()) return;
+
+    for (QJsonValue value : data.subaccounts) {
+        QJsonObject json = value.toObject();
+        Account* account = getOrCreateAccount(json.value("pointer").toInt());
+        account->update(json);
+        account->updateTransactions(data.transactions.value(account->m_pointer), true);
+    }
+
+    emit accountsChanged();
+    if (!m_current_account) {
+        setCurrentAccount(m_accounts.first());
+    }
 }
 
 void Wallet::refreshAssets()
 {
     Q_ASSERT(m_network->isLiquid());
+    if (!m_asset_cache) m_asset_cache = new AssetCache(m_network);
+
+    m_context->post([this] {
+        // Only the first call after login has cached assets to apply.
+        const auto cached = m_asset_cache->load();
+        if (!cached.isEmpty()) {
+            QMetaObject::invokeMethod(this, [this, cached] { updateAssets(cached); });
+        }
+        if (!m_asset_cache->isStale()) return;
 
-    QMetaObject::invokeMethod(m_context, [this] {
         auto params = Json::fromObject({
             { "assets", true },
             { "icons", true },
@@ -554,33 +840,34 @@ void Wallet::refreshAssets()
         });
         GA_json* output;
         int err = GA_refresh_assets(m_session, params, &output);
-        Q_ASSERT(err == GA_OK);
-        err = GA_destroy_json(params);
-        Q_ASSERT(err == GA_OK);
+        GA_destroy_json(params);
+        // Keep the cached registry, the download is retried on next reload.
+        if (err != GA_OK) return;
 
         auto assets = Json::toObject(output);
         err = GA_destroy_json(output);
         Q_ASSERT(err == GA_OK);
 
-        QMetaObject::invokeMethod(this, [this, assets] {
-            auto icons = assets.value("icons").toObject();
-
-            for (auto&& ref : assets.value("assets").toObject()) {
-                QString id = ref.toObject().value("asset_id").toString();
-                if (id.isEmpty()) continue;
-                Asset* asset = getOrCreateAsset(id);
-                asset->setData(ref.toObject());
-                if (icons.contains(id)) {
-                    asset->setIcon("data:image/png;base64," + icons.value(id).toString());
-                }
-            }
-            for (auto account : m_accounts) {
-                account->updateBalance();
-            }
-        });
+        const auto changed = m_asset_cache->update(assets.value("assets").toObject(), assets.value("icons").toObject());
+        if (changed.isEmpty()) return;
+        QMetaObject::invokeMethod(this, [this, changed] { updateAssets(changed); });
     });
 }
 
+void Wallet::updateAssets(const AssetCache::Entries& entries)
+{
+    for (auto i = entries.constBegin(); i != entries.constEnd(); ++i) {
+        Asset* asset = getOrCreateAsset(i.key());
+        asset->setData(i.value().data);
+        if (!i.value().icon.isEmpty()) {
+            asset->setIcon(i.value().icon);
+        }
+    }
+    for (auto account : m_accounts) {
+        account->updateBalance();
+    }
+}
+
 void Wallet::setCurrentAccount(Account *currentAccount)
 {
     Q_ASSERT(!currentAccount || currentAccount->wallet() == this);
@@ -620,9 +907,21 @@ void Wallet::updateCurrencies()
     GA_destroy_json(currencies);
 }
 
+void Wallet::loadPinData()
+{
+    if (m_pin_data_loaded) return;
+    m_pin_data_loaded = true;
+    QFile file(GetDataFile("wallets", m_id));
+    if (!file.open(QFile::ReadOnly)) return;
+    const auto data = QJsonDocument::fromJson(file.readAll()).object();
+    m_pin_data = QByteArray::fromBase64(data.value("pin_data").toString().toLocal8Bit());
+}
+
 void Wallet::save()
 {
     if (m_id.isEmpty()) return;
+    // Keep the PIN data of a wallet that wasn't opened yet.
+    loadPinData();
     QJsonDocument doc({
         { "version", 1 },
         { "name", m_name },
@@ -632,12 +931,13 @@ void Wallet::save()
         { "proxy", m_proxy },
         { "use_tor", m_use_tor }
     });
-    QFile file(GetDataFile("wallets", m_id));
-    bool result = file.open(QFile::ReadWrite);
+    QSaveFile file(GetDataFile("wallets", m_id));
+    bool result = file.open(QFile::WriteOnly);
     Q_ASSERT(result);
     file.write(doc.toJson());
-    result = file.flush();
+    result = file.commit();
     Q_ASSERT(result);
+    WalletManager::instance()->saveIndex();
 }
 
 void Wallet::setConnection(ConnectionStatus connection)
@@ -658,13 +958,42 @@ void Wallet::setAuthentication(AuthenticationStatus authentication)
 
 QJsonObject Wallet::convert(const QJsonObject& value) const
 {
-    auto details = Json::fromObject(value);
-    GA_json* balance;
-    int err = GA_convert_amount(m_session, details, &balance);
-    GA_destroy_json(details);
-    if (err != GA_OK) return {};
-    QJsonObject result = Json::toObject(balance);
-    GA_destroy_json(balance);
+    // Same input and output as GA_convert_amount, computed locally with
+    // the cached exchange rate.
+    static const QStringList units{ "sats", "ubtc", "bits", "mbtc", "btc" };
+
+    qint64 satoshi = 0;
+    if (value.contains("satoshi")) {
+        satoshi = value.value("satoshi").toVariant().toLongLong();
+    } else if (value.contains("fiat")) {
+        const double rate = m_fiat_rate.toDouble();
+        bool ok;
+        const double fiat = value.value("fiat").toString().toDouble(&ok);
+        if (!ok || rate <= 0) return {};
+        satoshi = qRound64(fiat / rate * 100000000.0);
+    } else {
+        bool ok = false;
+        for (const auto& unit : units) {
+            if (!value.contains(unit)) continue;
+            ok = Amount::parse(value.value(unit).toString(), Amount::decimals(unit), &satoshi);
+            break;
+        }
+        if (!ok) return {};
+    }
+
+    QJsonObject result{{ "satoshi", satoshi }};
+    for (const auto& unit : units) {
+        result.insert(unit, Amount::toString(satoshi, Amount::decimals(unit)));
+    }
+    if (m_fiat_rate.isEmpty()) {
+        result.insert("fiat", QJsonValue::Null);
+        result.insert("fiat_rate", QJsonValue::Null);
+    } else {
+        const double fiat = static_cast<double>(satoshi) * m_fiat_rate.toDouble() / 100000000.0;
+        result.insert("fiat", QString::number(fiat, 'f', 2));
+        result.insert("fiat_rate", m_fiat_rate);
+    }
+    result.insert("fiat_currency", m_fiat_currency);
     return result;
 }
 
@@ -676,14 +1005,8 @@ QString Wallet::formatAmount(qint64 amount, bool include_ticker) const
 QString Wallet::formatAmount(qint64 amount, bool include_ticker, const QString& unit) const
 {
     Q_ASSERT(m_network);
-    auto str = convert({{ "satoshi", amount }}).value(unit == "\u00B5BTC" ? "ubtc" : unit.toLower()).toString();
-    auto val = str.toDouble();
-    if (val == ((int64_t) val)) {
-        str = QLocale::system().toString(val, 'f', 0);
-    } else {
-        str = QLocale::system().toString(val, 'f', 8);
-        str.remove(QRegExp("\\.?0+$"));
-    }
+    const int decimals = Amount::decimals(unit);
+    auto str = decimals < 0 ? QString() : Amount::format(amount, decimals, QLocale::system());
     if (include_ticker) {
         str += (m_network->isLiquid() ? " L-" : " ") + unit;
     }
@@ -697,30 +1020,63 @@ qint64 Wallet::amountToSats(const QString& amount) const
 
 qint64 Wallet::parseAmount(const QString& amount, const QString& unit) const
 {
-    if (amount.isEmpty()) return 0;
-    QString sanitized_amount = amount;
-    sanitized_amount.replace(',', '.');
-    auto details = Json::fromObject({{ unit == "\u00B5BTC" ? "ubtc" : unit.toLower(), sanitized_amount }});
-    GA_json* balance;
-    int err = GA_convert_amount(m_session, details, &balance);
-    if (err != GA_OK) return 0;
-    GA_destroy_json(details);
-    QJsonObject result = Json::toObject(balance);
-    GA_destroy_json(balance);
-    return result.value("sats").toString().toLongLong();
+    qint64 satoshi;
+    if (!Amount::parse(amount, Amount::decimals(unit), &satoshi)) return 0;
+    return satoshi;
 }
 
-Asset* Wallet::getOrCreateAsset(const QString& id)
+void Wallet::updateFiatRate()
+{
+    // Requests that arrive while one is queued are covered by it.
+    if (m_fiat_rate_pending) return;
+    m_fiat_rate_pending = true;
+
+    // The only GA_convert_amount call, everything else is converted
+    // locally with this rate.
+    m_context->post([this] {
+        const auto result = GA::convert_amount(m_session, {{ "satoshi", 0 }});
+        const auto rate = result.value("fiat_rate").toString();
+        const auto currency = result.value("fiat_currency").toString();
+        QMetaObject::invokeMethod(this, [this, rate, currency] {
+            m_fiat_rate_pending = false;
+            // The session was destroyed meanwhile.
+            if (!m_session) return;
+            if (m_fiat_rate == rate && m_fiat_currency == currency) return;
+            m_fiat_rate = rate;
+            m_fiat_currency = currency;
+            emit fiatRateChanged();
+        });
+    });
+}
+
+int Wallet::assetIndex(const QString& id)
 {
     Q_ASSERT(m_network && m_network->isLiquid());
-    QString key = id == "btc" ? "6f0279e9ed041c3d710a9f57d0c02928416460c4b722ae3457a11eec381c526d" : id;
+    if (m_assets.isEmpty()) {
+        m_assets.append(new Asset(LBTC_ID, 0, this));
+        m_asset_indexes.insert(assetKey(LBTC_ID), 0);
+        m_asset_indexes.insert(assetKey("btc"), 0);
+    }
 
-    Asset* asset = m_assets.value(key);
-    if (!asset) {
-        asset = new Asset(key, this);
-        m_assets.insert(key, asset);
+    const auto key = assetKey(id);
+    int index = m_asset_indexes.value(key, -1);
+    if (index < 0) {
+        Q_ASSERT(key.size() == ASSET_ID_SIZE);
+        index = m_assets.size();
+        m_assets.append(new Asset(id, index, this));
+        m_asset_indexes.insert(key, index);
     }
-    return asset;
+    return index;
+}
+
+int Wallet::findAsset(const QString& id) const
+{
+    return m_asset_indexes.value(assetKey(id), -1);
+}
+
+Asset* Wallet::getOrCreateAsset(const QString& id)
+{
+    return m_assets.at(assetIndex(id));
 }
 
 void Wallet::setBusy(bool busy)
@@ -765,19 +1121,21 @@ void Wallet::setSession()
 void Wallet::setSettings(const QJsonObject& settings)
 {
     if (m_settings == settings) return;
+    const bool pricing_changed = m_settings.value("pricing") != settings.value("pricing");
     m_settings = settings;
+    if (pricing_changed) updateFiatRate();
     emit settingsChanged();
 
     if (m_logout_timer != -1 ) {
         killTimer(m_logout_timer);
         m_logout_timer = -1;
     }
-    int altimeout = m_settings.value("altimeout").toInt();
+    int altimeout = m_auto_logout ? m_settings.value("altimeout").toInt() : 0;
     if (altimeout > 0) {
         m_logout_timer = startTimer(altimeout * 60 * 1000);
-        qApp->installEventFilter(this);
+        QCoreApplication::instance()->installEventFilter(this);
     } else {
-        qApp->removeEventFilter(this);
+        QCoreApplication::instance()->removeEventFilter(this);
     }
 }
 
@@ -2,17 +2,25 @@
 #define GREEN_WALLET_H
 
 #include <QtQml>
-#include <QAtomicInteger>
+#include <QHash>
 #include <QList>
+#include <QMutex>
 #include <QObject>
 #include <QQmlListProperty>
-#include <QThread>
+#include <QSet>
 #include <QJsonObject>
+#include <QVector>
+
+#include "assetcache.h"
+#include "exportjob.h"
+#include "feeestimates.h"
 
 class Account;
 class Asset;
 class Device;
+class Executor;
 class Network;
+class WalletCache;
 
 struct GA_session;
 struct GA_auth_handler;
@@ -47,9 +55,11 @@ private:
     Q_PROPERTY(bool useTor READ useTor NOTIFY useTorChanged)
     Q_PROPERTY(bool locked READ isLocked NOTIFY lockedChanged)
     Q_PROPERTY(QJsonObject settings READ settings NOTIFY settingsChanged)
+    Q_PROPERTY(QString fiatRate READ fiatRate NOTIFY fiatRateChanged)
     Q_PROPERTY(QJsonObject currencies READ currencies CONSTANT)
     Q_PROPERTY(QQmlListProperty<Account> accounts READ accounts NOTIFY accountsChanged)
     Q_PROPERTY(QJsonObject events READ events NOTIFY eventsChanged)
+    Q_PROPERTY(FeeEstimates* feeEstimates READ feeEstimates CONSTANT)
     Q_PROPERTY(QStringList mnemonic READ mnemonic CONSTANT)
     Q_PROPERTY(int loginAttemptsRemaining READ loginAttemptsRemaining NOTIFY loginAttemptsRemainingChanged)
     Q_PROPERTY(QJsonObject config READ config NOTIFY configChanged)
@@ -85,10 +95,13 @@ public:
 
     QQmlListProperty<Account> accounts();
 
-    void handleNotification(const QJsonObject& notification);
+    // Thread safe, notifications are handled in batches on the wallet thread.
+    void queueNotification(const QJsonObject& notification);
 
     QJsonObject events() const;
 
+    FeeEstimates* feeEstimates() const { return m_fee_estimates; }
+
     QStringList mnemonic() const;
 
     int loginAttemptsRemaining() const { return m_login_attempts_remaining; }
@@ -101,6 +114,8 @@ public:
     Q_INVOKABLE void loginWithPin(const QByteArray& pin);
     Q_INVOKABLE void changePin(const QByteArray& pin);
     Q_INVOKABLE QJsonObject convert(const QJsonObject& value) const;
+    // Empty until the exchange rate is known.
+    QString fiatRate() const { return m_fiat_rate; }
 
     qint64 amountToSats(const QString& amount) const;
     Q_INVOKABLE qint64 parseAmount(const QString& amount, const QString& unit) const;
@@ -108,8 +123,18 @@ public:
     QString formatAmount(qint64 amount, bool include_ticker) const;
     Q_INVOKABLE QString formatAmount(qint64 amount, bool include_ticker, const QString& unit) const;
 
+    // Index of the asset in the asset table, interning the asset if it's
+    // new. The id is either hex or "btc" for L-BTC, which is always at 0.
+    int assetIndex(const QString& id);
+    // Index of a known asset, -1 otherwise.
+    int findAsset(const QString& id) const;
+    Asset* asset(int index) const { return m_assets.at(index); }
     Q_INVOKABLE Asset* getOrCreateAsset(const QString& id);
 
+    // Asks for a file and exports the confirmed transactions of all
+    // accounts, merged by date, returns the running job or null if canceled.
+    Q_INVOKABLE ExportJob* exportTransactions(ExportJob::Format format);
+
     bool isBusy() const { return m_busy; }
     void setBusy(bool busy);
 
@@ -144,6 +169,7 @@ signals:
     void nameChanged(QString name);
     void loginAttemptsRemainingChanged(int loginAttemptsRemaining);
     void settingsChanged();
+    void fiatRateChanged();
     void configChanged();
     void busyChanged(bool busy);
     void hasLiquidSecuritiesChanged(bool hasLiquidSecurities);
@@ -159,16 +185,30 @@ private:
     void setSettings(const QJsonObject& settings);
     void connectNow();
     void updateCurrencies();
+    void updateFiatRate();
+    void loadCache();
+    // Stops the history fetches of running exports.
+    void cancelExports();
+    void updateAssets(const AssetCache::Entries& entries);
+    void handleNotifications(const QList<QJsonObject>& notifications);
+    void refreshBalances(const QSet<int>& pointers);
 
     Account* m_current_account{nullptr};
     QString m_networkName;
 
 public:
     QString m_id;
-    QThread* m_thread{nullptr};
-    QObject* m_context{nullptr};
-    QAtomicInteger<qint64> m_last_timestamp;
+    Executor* const m_context;
+    QTimer* const m_busy_timer;
+    QTimer* const m_notification_timer;
+    FeeEstimates* const m_fee_estimates;
+    QMutex m_notifications_mutex;
+    QList<QJsonObject> m_notifications;
+    QSet<int> m_balance_requests;
+    bool m_balance_refresh_pending{false};
     GA_session* m_session{nullptr};
+    WalletCache* m_cache{nullptr};
+    AssetCache* m_asset_cache{nullptr};
     ConnectionStatus m_connection{Disconnected};
     AuthenticationStatus m_authentication{Unauthenticated};
     bool m_locked{true};
@@ -176,18 +216,34 @@ public:
     QJsonObject m_config;
     QJsonObject m_currencies;
     QJsonObject m_events;
-    QMap<QString, Asset*> m_assets;
+    QString m_fiat_rate;
+    bool m_fiat_rate_pending{false};
+    bool m_ticker_pushed{false};
+    QString m_fiat_currency;
+    // Asset table, by index.
+    QVector<Asset*> m_assets;
+    // Binary asset ids, and "btc", to index in m_assets.
+    QHash<QByteArray, int> m_asset_indexes;
     QList<Account*> m_accounts;
+    // Cancel flags of the exports still fetching history.
+    QVector<ExportJob::CancelFlag> m_exports;
     QMap<int, Account*> m_accounts_by_pointer;
 
     QByteArray getPinData() const;
+    void loadPinData();
     QByteArray m_pin_data;
+    // False for wallets created from the index until the PIN data is read
+    // from the wallet file.
+    bool m_pin_data_loaded{true};
     QString m_name;
     Network* m_network{nullptr};
     int m_login_attempts_remaining{3};
     QString m_proxy;
     bool m_use_tor{false};
     int m_logout_timer{-1};
+    // Log out after the altimeout setting without user input, disabled in
+    // daemon mode.
+    bool m_auto_logout{true};
     bool m_busy{false};
     bool m_has_liquid_securities{false};
 
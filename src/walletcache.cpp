@@ -0,0 +1,234 @@
+#include "util.h"
+#include "walletcache.h"
+
+#include <QCborArray>
+#include <QCborValue>
+#include <QCryptographicHash>
+#include <QHash>
+#include <QSaveFile>
+#include <QSet>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char MAGIC[4] = { 'G', 'W', 'C', 'F' };
+const quint32 VERSION = 1;
+const int HEADER_SIZE = sizeof(MAGIC) + sizeof(quint32);
+const int RECORD_HEADER_SIZE = sizeof(quint8) + sizeof(quint32);
+
+QByteArray header()
+{
+    QByteArray data(MAGIC, sizeof(MAGIC));
+    uchar version[sizeof(quint32)];
+    qToLittleEndian(VERSION, version);
+    data.append(reinterpret_cast<const char*>(version), sizeof(version));
+    return data;
+}
+
+void appendRecord(QByteArray& out, quint8 type, const QByteArray& payload)
+{
+    uchar length[sizeof(quint32)];
+    qToLittleEndian(static_cast<quint32>(payload.size()), length);
+    out.append(static_cast<char>(type));
+    out.append(reinterpret_cast<const char*>(length), sizeof(length));
+    out.append(payload);
+}
+
+QByteArray transactionPayload(int pointer, const QJsonValue& transaction)
+{
+    return QCborArray{ pointer, QCborValue::fromJsonValue(transaction) }.toCborValue().toCbor();
+}
+
+QByteArray removedPayload(int pointer, const QString& hash)
+{
+    return QCborArray{ pointer, hash }.toCborValue().toCbor();
+}
+
+QByteArray digest(const QByteArray& payload)
+{
+    return QCryptographicHash::hash(payload, QCryptographicHash::Sha1);
+}
+
+} // namespace
+
+WalletCache::WalletCache(const QString& id)
+    : m_file(GetDataFile("cache", id))
+{
+}
+
+WalletCache::Data WalletCache::load()
+{
+    QMutexLocker locker(&m_mutex);
+    m_file.close();
+
+    Data data;
+    m_digests.clear();
+    if (!m_file.open(QFile::ReadOnly)) return data;
+
+    const qint64 size = m_file.size();
+    QByteArray buffer;
+    const uchar* bytes = size > 0 ? m_file.map(0, size) : nullptr;
+    const bool mapped = bytes;
+    if (!mapped) {
+        buffer = m_file.readAll();
+        bytes = reinterpret_cast<const uchar*>(buffer.constData());
+    }
+
+    QHash<int, QHash<QString, QJsonObject>> transactions;
+    int records = 0;
+    int live = 0;
+    bool valid = size >= HEADER_SIZE &&
+            memcmp(bytes, MAGIC, sizeof(MAGIC)) == 0 &&
+            qFromLittleEndian<quint32>(bytes + sizeof(MAGIC)) == VERSION;
+    qint64 offset = HEADER_SIZE;
+    while (valid && offset < size) {
+        if (size - offset < RECORD_HEADER_SIZE) {
+            valid = false;
+            break;
+        }
+        const quint8 type = bytes[offset];
+        const quint32 length = qFromLittleEndian<quint32>(bytes + offset + 1);
+        offset += RECORD_HEADER_SIZE;
+        if (size - offset < length) {
+            // Partially written record, the rest of the file is discarded.
+            valid = false;
+            break;
+        }
+        const auto payload = QByteArray::fromRawData(reinterpret_cast<const char*>(bytes + offset), static_cast<int>(length));
+        offset += length;
+        ++records;
+
+        const auto value = QCborValue::fromCbor(payload);
+        if (type == SubaccountsRecord) {
+            data.subaccounts = value.toJsonValue().toArray();
+        } else if (type == TransactionRecord) {
+            const auto record = value.toArray();
+            const int pointer = static_cast<int>(record.at(0).toInteger());
+            const auto transaction = record.at(1).toJsonValue().toObject();
+            const auto hash = transaction.value("txhash").toString();
+            if (hash.isEmpty()) continue;
+            auto& by_hash = transactions[pointer];
+            if (!by_hash.contains(hash)) ++live;
+            by_hash.insert(hash, transaction);
+        } else if (type == RemovedTransactionRecord) {
+            const auto record = value.toArray();
+            const int pointer = static_cast<int>(record.at(0).toInteger());
+            if (transactions[pointer].remove(record.at(1).toString()) > 0) --live;
+        }
+    }
+
+    if (mapped) m_file.unmap(const_cast<uchar*>(bytes));
+    m_file.close();
+
+    for (auto i = transactions.constBegin(); i != transactions.constEnd(); ++i) {
+        auto list = i.value().values();
+        std::stable_sort(list.begin(), list.end(), [](const QJsonObject& a, const QJsonObject& b) {
+            return a.value("created_at").toString() > b.value("created_at").toString();
+        });
+        QJsonArray array;
+        auto& digests = m_digests[i.key()];
+        for (const auto& transaction : list) {
+            array.append(transaction);
+            digests.insert(transaction.value("txhash").toString(), digest(transactionPayload(i.key(), transaction)));
+        }
+        data.transactions.insert(i.key(), array);
+    }
+
+    // Drop superseded and damaged records.
+    if (!valid || records > 2 * (live + 1)) {
+        rewrite(data);
+    }
+
+    return data;
+}
+
+void WalletCache::appendSubaccounts(const QJsonArray& subaccounts)
+{
+    QMutexLocker locker(&m_mutex);
+    append(SubaccountsRecord, QCborValue::fromJsonValue(subaccounts).toCbor());
+}
+
+void WalletCache::appendTransactions(int pointer, const QJsonArray& transactions, bool complete)
+{
+    QMutexLocker locker(&m_mutex);
+    auto& digests = m_digests[pointer];
+    QByteArray data;
+    QSet<QString> hashes;
+    for (const auto& transaction : transactions) {
+        const auto hash = transaction.toObject().value("txhash").toString();
+        if (hash.isEmpty()) continue;
+        hashes.insert(hash);
+        const auto payload = transactionPayload(pointer, transaction);
+        const auto value = digest(payload);
+        // Pages already cached as is are fetched on every reload.
+        if (digests.value(hash) == value) continue;
+        digests.insert(hash, value);
+        appendRecord(data, TransactionRecord, payload);
+    }
+    if (complete) {
+        // Replaced, double spent or dropped transactions.
+        for (auto i = digests.begin(); i != digests.end();) {
+            if (hashes.contains(i.key())) {
+                ++i;
+                continue;
+            }
+            appendRecord(data, RemovedTransactionRecord, removedPayload(pointer, i.key()));
+            i = digests.erase(i);
+        }
+    }
+    if (data.isEmpty() || !open()) return;
+    m_file.write(data);
+    m_file.flush();
+}
+
+void WalletCache::remove()
+{
+    QMutexLocker locker(&m_mutex);
+    m_digests.clear();
+    m_file.close();
+    m_file.remove();
+}
+
+bool WalletCache::open()
+{
+    if (m_file.isOpen()) return true;
+    if (!m_file.open(QFile::WriteOnly | QFile::Append)) return false;
+    // Also fixes files written by versions that used the default mode.
+    SetOwnerOnly(m_file);
+    if (m_file.size() == 0) m_file.write(header());
+    return true;
+}
+
+void WalletCache::append(RecordType type, const QByteArray& payload)
+{
+    if (!open()) return;
+    QByteArray data;
+    appendRecord(data, type, payload);
+    m_file.write(data);
+    m_file.flush();
+}
+
+void WalletCache::rewrite(const Data& data)
+{
+    m_file.close();
+
+    QSaveFile file(m_file.fileName());
+    if (!file.open(QFile::WriteOnly)) return;
+    SetOwnerOnly(file);
+    QByteArray buffer = header();
+    if (!data.subaccounts.isEmpty()) {
+        appendRecord(buffer, SubaccountsRecord, QCborValue::fromJsonValue(data.subaccounts).toCbor());
+    }
+    for (auto i = data.transactions.constBegin(); i != data.transactions.constEnd(); ++i) {
+        // Oldest first so that appending keeps the file in history order.
+        const auto& transactions = i.value();
+        for (int index = transactions.size() - 1; index >= 0; --index) {
+            appendRecord(buffer, TransactionRecord, transactionPayload(i.key(), transactions.at(index)));
+        }
+    }
+    file.write(buffer);
+    file.commit();
+}
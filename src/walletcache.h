@@ -0,0 +1,60 @@
+#ifndef GREEN_WALLETCACHE_H
+#define GREEN_WALLETCACHE_H
+
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QMap>
+#include <QMutex>
+
+// Local copy of the subaccounts (including balances) and transactions of a
+// wallet, used to show the wallet right after authentication while GDK is
+// queried in the background.
+//
+// The data is stored unencrypted, only readable by the current user, so
+// anyone with access to that account can read the wallet history without
+// the PIN.
+//
+// The file is a sequence of length prefixed CBOR records which are only ever
+// appended, a later record for the same subaccount or transaction replaces
+// the earlier one and a removal record drops it. Transactions are only
+// appended when they differ from the cached ones. The file is compacted when
+// it is loaded.
+class WalletCache
+{
+public:
+    struct Data {
+        QJsonArray subaccounts;
+        // Transactions by subaccount pointer, newest first.
+        QMap<int, QJsonArray> transactions;
+    };
+
+    explicit WalletCache(const QString& id);
+
+    Data load();
+    void appendSubaccounts(const QJsonArray& subaccounts);
+    // When complete, the transactions are the whole history of the
+    // subaccount and cached transactions not in it are removed.
+    void appendTransactions(int pointer, const QJsonArray& transactions, bool complete);
+    void remove();
+
+private:
+    enum RecordType : quint8 {
+        SubaccountsRecord = 1,
+        TransactionRecord = 2,
+        RemovedTransactionRecord = 3
+    };
+
+    bool open();
+    void append(RecordType type, const QByteArray& payload);
+    void rewrite(const Data& data);
+
+    QMutex m_mutex;
+    QFile m_file;
+    // Digest of the cached payload of each transaction, by subaccount
+    // pointer and hash.
+    QHash<int, QHash<QString, QByteArray>> m_digests;
+};
+
+#endif // GREEN_WALLETCACHE_H
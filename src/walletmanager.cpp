@@ -1,13 +1,20 @@
+#include "executor.h"
 #include "ga.h"
 #include "json.h"
 #include "network.h"
 #include "networkmanager.h"
 #include "util.h"
 #include "wallet.h"
+#include "walletcache.h"
 #include "walletmanager.h"
 
+#include <QDateTime>
 #include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
 #include <QJsonDocument>
+#include <QSaveFile>
 #include <QSet>
 #include <QSettings>
 #include <QStandardPaths>
@@ -18,6 +25,31 @@
 
 #include <gdk.h>
 
+namespace {
+
+const int INDEX_VERSION = 2;
+
+// Name, network and connection settings of all wallets, so that listing
+// them takes a single read. The wallet files remain the source of truth.
+// Each wallet entry, and each file that isn't a usable wallet, records the
+// modification time of its file.
+QString IndexPath()
+{
+    return GetDataFile("app", "wallets.json");
+}
+
+QList<QFileInfo> WalletFiles()
+{
+    return QDir(GetDataDir("wallets")).entryInfoList(QDir::Files);
+}
+
+qint64 Modified(const QFileInfo& info)
+{
+    return info.lastModified().toMSecsSinceEpoch();
+}
+
+} // namespace
+
 WalletManager::WalletManager()
 {
     auto config = Json::fromObject({{ "datadir", GetDataDir("gdk") }});
@@ -59,6 +91,65 @@ WalletManager::WalletManager()
         QFile::remove(GetDataFile("app", "wallets.ini"));
     }
 
+    if (!loadIndex()) {
+        scanWallets();
+        saveIndex();
+    }
+}
+
+// Creates the wallets listed in the index, their PIN data is only read when
+// needed. Fails if the index is missing or doesn't match the wallet files,
+// including files changed since the index was written, or if it lists a
+// wallet of an unknown network, which a rescan then skips.
+bool WalletManager::loadIndex()
+{
+    QFile file(IndexPath());
+    if (!file.open(QFile::ReadOnly)) return false;
+    QJsonParseError parser_error;
+    const auto doc = QJsonDocument::fromJson(file.readAll(), &parser_error);
+    if (parser_error.error != QJsonParseError::NoError || !doc.isObject()) return false;
+    if (doc.object().value("version").toInt() != INDEX_VERSION) return false;
+    const auto entries = doc.object().value("wallets").toArray();
+    const auto skipped = doc.object().value("skipped").toArray();
+
+    // Listing the directory is cheap compared to reading each file, and
+    // catches wallets added, removed or changed by other versions.
+    QHash<QString, qint64> files;
+    for (const auto& info : WalletFiles()) files.insert(info.fileName(), Modified(info));
+    auto matches = [&files](const QJsonValue& entry, const char* key) {
+        const auto data = entry.toObject();
+        const auto name = data.value(key).toString();
+        return files.contains(name) && files.take(name) == data.value("modified").toVariant().toLongLong();
+    };
+    auto network_manager = NetworkManager::instance();
+    for (const auto& entry : entries) {
+        if (!matches(entry, "id")) return false;
+        if (!network_manager->network(entry.toObject().value("network").toString())) return false;
+    }
+    for (const auto& entry : skipped) {
+        if (!matches(entry, "file")) return false;
+    }
+    if (!files.isEmpty()) return false;
+
+    for (const auto& entry : entries) {
+        const auto data = entry.toObject();
+        Wallet* wallet = new Wallet(this);
+        wallet->m_id = data.value("id").toString();
+        wallet->m_proxy = data.value("proxy").toString("");
+        wallet->m_use_tor = data.value("use_tor").toBool(false);
+        wallet->m_pin_data_loaded = false;
+        wallet->m_name = data.value("name").toString();
+        wallet->m_network = network_manager->network(data.value("network").toString());
+        wallet->m_login_attempts_remaining = data.value("login_attempts_remaining").toInt();
+        m_wallets.append(wallet);
+        emit walletAdded(wallet);
+    }
+    emit changed();
+    return true;
+}
+
+void WalletManager::scanWallets()
+{
     QDirIterator it(GetDataDir("wallets"));
     while (it.hasNext()) {
         QFile file(it.next());
@@ -68,18 +159,59 @@ WalletManager::WalletManager()
         if (parser_error.error != QJsonParseError::NoError) continue;
         if (!doc.isObject()) continue;
         auto data = doc.object();
+        auto network = NetworkManager::instance()->network(data.value("network").toString());
+        if (!network) continue;
         Wallet* wallet = new Wallet(this);
-        wallet->m_id = QFileInfo(file).baseName();
+        wallet->m_id = QFileInfo(file).fileName();
         wallet->m_proxy = data.value("proxy").toString("");
         wallet->m_use_tor = data.value("use_tor").toBool(false);
         wallet->m_pin_data = QByteArray::fromBase64(data.value("pin_data").toString().toLocal8Bit());
         wallet->m_name = data.value("name").toString();
-        wallet->m_network = NetworkManager::instance()->network(data.value("network").toString());
+        wallet->m_network = network;
         wallet->m_login_attempts_remaining = data.value("login_attempts_remaining").toInt();
         addWallet(wallet);
     }
 }
 
+void WalletManager::saveIndex() const
+{
+    QHash<QString, Wallet*> wallets;
+    for (Wallet* wallet : m_wallets) {
+        // Device wallets aren't persisted.
+        if (!wallet->m_id.isEmpty() && wallet->m_network) wallets.insert(wallet->m_id, wallet);
+    }
+    // Files that aren't wallets, like unreadable ones or leftover temporary
+    // files, are recorded too so that they don't invalidate the index.
+    QJsonArray entries, skipped;
+    for (const auto& info : WalletFiles()) {
+        Wallet* wallet = wallets.value(info.fileName());
+        if (!wallet) {
+            skipped.append(QJsonObject{
+                { "file", info.fileName() },
+                { "modified", Modified(info) }
+            });
+            continue;
+        }
+        entries.append(QJsonObject{
+            { "id", wallet->m_id },
+            { "modified", Modified(info) },
+            { "name", wallet->m_name },
+            { "network", wallet->m_network->id() },
+            { "login_attempts_remaining", wallet->m_login_attempts_remaining },
+            { "proxy", wallet->m_proxy },
+            { "use_tor", wallet->m_use_tor }
+        });
+    }
+    QSaveFile file(IndexPath());
+    if (!file.open(QFile::WriteOnly)) return;
+    file.write(QJsonDocument(QJsonObject{
+        { "version", INDEX_VERSION },
+        { "wallets", entries },
+        { "skipped", skipped }
+    }).toJson(QJsonDocument::Compact));
+    file.commit();
+}
+
 WalletManager *WalletManager::instance()
 {
     static WalletManager wallet_manager;
@@ -106,7 +238,7 @@ void WalletManager::insertWallet(Wallet* wallet)
     Q_ASSERT(!file.exists());
     addWallet(wallet);
 
-    QMetaObject::invokeMethod(wallet->m_context, [wallet] {
+    wallet->m_context->post([wallet] {
         QMetaObject::invokeMethod(wallet, [wallet] {
             wallet->save();
         });
@@ -120,10 +252,13 @@ void WalletManager::removeWallet(Wallet* wallet)
     m_wallets.removeOne(wallet);
     emit changed();
     if (!wallet->m_id.isEmpty()) {
-        QMetaObject::invokeMethod(wallet->m_context, [wallet] {
+        wallet->m_context->post([wallet] {
             QMetaObject::invokeMethod(wallet, [wallet] {
                 bool result = QFile::remove(GetDataFile("wallets", wallet->m_id));
                 Q_ASSERT(result);
+                if (!wallet->m_cache) wallet->m_cache = new WalletCache(wallet->m_id);
+                wallet->m_cache->remove();
+                WalletManager::instance()->saveIndex();
             });
         });
     }
@@ -27,6 +27,9 @@ public:
 
     QString newWalletName(Network* network) const;
 
+    // Rewrites the wallet index, called whenever a wallet is saved.
+    void saveIndex() const;
+
 signals:
     void changed();
     void walletAdded(Wallet* wallet);
@@ -39,6 +42,9 @@ public slots:
 private:
     explicit WalletManager();
 
+    bool loadIndex();
+    void scanWallets();
+
 public:
     QVector<Wallet*> m_wallets;
 };
@@ -1,3 +1,4 @@
+#include "trace.h"
 #include "wally.h"
 
 #include <QSet>
@@ -14,6 +15,7 @@ namespace {
 
 QStringList GetWordlist()
 {
+    Trace::Scope trace("bip39_get_wordlist");
     QStringList wordlist;
     words* ws;
     bip39_get_wordlist(nullptr, &ws);
@@ -27,8 +29,19 @@ QStringList GetWordlist()
     return wordlist;
 }
 
-QStringList g_wordlist{GetWordlist()};
-QSet<QString> g_wordset{g_wordlist.begin(), g_wordlist.end()};
+// Built on first use instead of during static initialization, so that it
+// doesn't delay startup.
+const QStringList& Wordlist()
+{
+    static const QStringList wordlist{GetWordlist()};
+    return wordlist;
+}
+
+const QSet<QString>& Wordset()
+{
+    static const QSet<QString> wordset{Wordlist().begin(), Wordlist().end()};
+    return wordset;
+}
 
 } // namespace
 
@@ -163,7 +176,7 @@ bool Word::setText(QString text) {
     // A suggestion is a word with same start as input text.
     QStringList suggestions;
     if (text.length() > 1) {
-        for (QString word : g_wordlist) {
+        for (QString word : Wordlist()) {
             if (word.startsWith(text)) {
                 suggestions.append(word);
                 //if (suggestions.length() == 5) break;
@@ -181,7 +194,7 @@ bool Word::setText(QString text) {
         m_suggestions = suggestions;
         emit suggestionsChanged();
     }
-    bool valid = g_wordset.contains(text);
+    bool valid = Wordset().contains(text);
     if (m_valid != valid) {
         m_valid = valid;
         emit validChanged(m_valid);
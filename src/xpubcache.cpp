@@ -0,0 +1,185 @@
+#include "network.h"
+#include "util.h"
+#include "xpubcache.h"
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+
+extern "C" {
+struct ext_key;
+int bip32_key_free(const struct ext_key *hdkey);
+int bip32_key_init_alloc(uint32_t version,
+                         uint32_t depth,
+                         uint32_t child_num,
+                         const unsigned char *chain_code,
+                         size_t chain_code_len,
+                         const unsigned char *pub_key,
+                         size_t pub_key_len,
+                         const unsigned char *priv_key,
+                         size_t priv_key_len,
+                         const unsigned char *hash160,
+                         size_t hash160_len,
+                         const unsigned char *parent160,
+                         size_t parent160_len,
+                         struct ext_key **output);
+int bip32_key_from_base58_alloc(const char *base58, struct ext_key **output);
+int bip32_key_from_parent_path_alloc(const struct ext_key *hdkey,
+                                     const uint32_t *child_path,
+                                     size_t child_path_len,
+                                     uint32_t flags,
+                                     struct ext_key **output);
+int bip32_key_serialize(const struct ext_key *hdkey, uint32_t flags, unsigned char *bytes_out, size_t len);
+int bip32_key_to_base58(const struct ext_key *hdkey, uint32_t flags, char **output);
+int wally_free_string(char *str);
+}
+
+/** From wally_core.h and wally_bip32.h */
+#define WALLY_OK 0
+#define BIP32_VER_MAIN_PUBLIC  0x0488B21E
+#define BIP32_VER_TEST_PUBLIC  0x043587CF
+#define BIP32_INITIAL_HARDENED_CHILD 0x80000000
+#define BIP32_FLAG_KEY_PUBLIC  0x1
+#define BIP32_FLAG_SKIP_HASH   0x2
+#define BIP32_SERIALIZED_LEN   78
+
+namespace {
+
+QString pathToString(const XPubCache::Path& path)
+{
+    QStringList parts;
+    for (auto index : path) parts.append(QString::number(index));
+    return parts.join('/');
+}
+
+XPubCache::Path pathFromString(const QString& str)
+{
+    XPubCache::Path path;
+    if (str.isEmpty()) return path;
+    for (const auto& part : str.split('/')) path.append(part.toUInt());
+    return path;
+}
+
+} // namespace
+
+XPubCache::XPubCache(Network* network, const QString& root_xpub)
+    : m_network(network)
+{
+    // The file name doesn't reveal the root key.
+    const auto id = QCryptographicHash::hash((network->id() + ':' + root_xpub).toUtf8(), QCryptographicHash::Sha256).toHex();
+    m_file_name = GetDataFile("cache", "xpubs-" + id + ".json");
+
+    QFile file(m_file_name);
+    if (file.open(QIODevice::ReadOnly)) {
+        const auto xpubs = QJsonDocument::fromJson(file.readAll()).object();
+        for (auto i = xpubs.begin(); i != xpubs.end(); ++i) {
+            m_xpubs.insert(pathFromString(i.key()), i.value().toString());
+        }
+    }
+    m_xpubs.insert({}, root_xpub);
+}
+
+QString XPubCache::value(const Path& path)
+{
+    auto xpub = m_xpubs.value(path);
+    if (!xpub.isEmpty()) return xpub;
+
+    xpub = m_derived.value(path);
+    if (!xpub.isEmpty()) return xpub;
+
+    const auto prefix = hardenedPrefix(path);
+    if (prefix.size() == path.size()) return {};
+    const auto parent = m_xpubs.value(prefix);
+    if (parent.isEmpty()) return {};
+
+    xpub = derive(parent, path.mid(prefix.size()));
+    if (!xpub.isEmpty()) m_derived.insert(path, xpub);
+    return xpub;
+}
+
+void XPubCache::insert(const Path& path, const QString& xpub)
+{
+    m_xpubs.insert(path, xpub);
+}
+
+void XPubCache::save() const
+{
+    QJsonObject xpubs;
+    for (auto i = m_xpubs.begin(); i != m_xpubs.end(); ++i) {
+        if (i.key().isEmpty()) continue;
+        xpubs.insert(pathToString(i.key()), i.value());
+    }
+    QSaveFile file(m_file_name);
+    if (!file.open(QIODevice::WriteOnly)) return;
+    if (!SetOwnerOnly(file)) return;
+    file.write(QJsonDocument(xpubs).toJson(QJsonDocument::Compact));
+    file.commit();
+}
+
+XPubCache::Path XPubCache::hardenedPrefix(const Path& path)
+{
+    int size = path.size();
+    while (size > 0 && path.at(size - 1) < BIP32_INITIAL_HARDENED_CHILD) --size;
+    return path.mid(0, size);
+}
+
+QList<XPubCache::Path> XPubCache::parsePaths(const QJsonArray& paths)
+{
+    QList<Path> result;
+    for (const auto& path : paths) {
+        Path p;
+        for (const auto& index : path.toArray()) {
+            p.append(static_cast<uint32_t>(index.toDouble()));
+        }
+        result.append(p);
+    }
+    return result;
+}
+
+QString XPubCache::xpub(Network* network, const QByteArray& chain_code, const QByteArray& public_key)
+{
+    const uint32_t version = network->id() == "mainnet" ? BIP32_VER_MAIN_PUBLIC : BIP32_VER_TEST_PUBLIC;
+
+    // The device doesn't report depth and child number, keep them constant
+    // so that the same key always has the same serialization.
+    ext_key* key;
+    int err = bip32_key_init_alloc(version, 1, 0,
+        reinterpret_cast<const unsigned char*>(chain_code.constData()), chain_code.size(),
+        reinterpret_cast<const unsigned char*>(public_key.constData()), public_key.size(),
+        nullptr, 0, nullptr, 0, nullptr, 0, &key);
+    if (err != WALLY_OK) return {};
+
+    char* base58;
+    err = bip32_key_to_base58(key, BIP32_FLAG_KEY_PUBLIC, &base58);
+    bip32_key_free(key);
+    if (err != WALLY_OK) return {};
+
+    const QString result(base58);
+    wally_free_string(base58);
+    return result;
+}
+
+QString XPubCache::derive(const QString& parent, const Path& path) const
+{
+    ext_key* parent_key;
+    if (bip32_key_from_base58_alloc(parent.toLatin1().constData(), &parent_key) != WALLY_OK) return {};
+
+    ext_key* key;
+    int err = bip32_key_from_parent_path_alloc(parent_key, path.constData(), path.size(),
+                                               BIP32_FLAG_KEY_PUBLIC | BIP32_FLAG_SKIP_HASH, &key);
+    bip32_key_free(parent_key);
+    if (err != WALLY_OK) return {};
+
+    // Layout: version, depth, parent fingerprint, child number (13 bytes),
+    // chain code (32 bytes) and public key (33 bytes).
+    unsigned char bytes[BIP32_SERIALIZED_LEN];
+    err = bip32_key_serialize(key, BIP32_FLAG_KEY_PUBLIC, bytes, sizeof(bytes));
+    bip32_key_free(key);
+    if (err != WALLY_OK) return {};
+
+    const QByteArray chain_code(reinterpret_cast<const char*>(bytes) + 13, 32);
+    const QByteArray public_key(reinterpret_cast<const char*>(bytes) + 45, 33);
+    return xpub(m_network, chain_code, public_key);
+}
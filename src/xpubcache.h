@@ -0,0 +1,52 @@
+#ifndef GREEN_XPUBCACHE_H
+#define GREEN_XPUBCACHE_H
+
+#include <QJsonArray>
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+class Network;
+
+// Extended public keys of a device seed by derivation path. Keys of paths
+// ending in non hardened indexes are derived locally from the key of their
+// hardened prefix, so only hardened paths need to be asked to the device.
+//
+// The cache is identified by the root key of the seed and the network, and
+// requested keys are persisted so that logging in again with the same seed
+// doesn't query the device for each path. The file is only readable by the
+// current user, public keys reveal the addresses and history of the wallet.
+class XPubCache
+{
+public:
+    using Path = QVector<uint32_t>;
+
+    XPubCache(Network* network, const QString& root_xpub);
+
+    // Returns the cached or locally derived key, or an empty string if the
+    // key of the hardened prefix is unknown.
+    QString value(const Path& path);
+    // True if the key of the path was obtained from the device.
+    bool contains(const Path& path) const { return m_xpubs.contains(path); }
+    void insert(const Path& path, const QString& xpub);
+    void save() const;
+
+    // Leading part of the path up to and including the last hardened index.
+    static Path hardenedPrefix(const Path& path);
+    static QList<Path> parsePaths(const QJsonArray& paths);
+
+    // Serializes a public key the way GetWalletPublicKeyCommand reports it.
+    static QString xpub(Network* network, const QByteArray& chain_code, const QByteArray& public_key);
+
+private:
+    QString derive(const QString& parent, const Path& path) const;
+
+    Network* const m_network;
+    QString m_file_name;
+    // Keys as obtained from the device, persisted.
+    QMap<Path, QString> m_xpubs;
+    // Keys derived locally, only kept in memory.
+    QMap<Path, QString> m_derived;
+};
+
+#endif // GREEN_XPUBCACHE_H